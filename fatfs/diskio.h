@@ -22,6 +22,22 @@ typedef enum {
 } DRESULT;
 
 
+/* Disk access statistics (CTRL_GET_STATS) */
+typedef struct {
+	DWORD	n_read;		/* Number of disk_read calls */
+	DWORD	n_write;	/* Number of disk_write calls */
+	DWORD	sc_read;	/* Number of sectors read */
+	DWORD	sc_write;	/* Number of sectors written */
+} DSTATS;
+
+
+/* Scatter/gather segment (disk_readv/disk_writev) */
+typedef struct {
+	BYTE*	buff;		/* Data buffer */
+	UINT	count;		/* Number of sectors in the buffer */
+} DSEG;
+
+
 /*---------------------------------------*/
 /* Prototypes for disk control functions */
 
@@ -31,6 +47,10 @@ DSTATUS disk_status (BYTE pdrv);
 DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
+#if FF_USE_DISKIOV
+DRESULT disk_readv (BYTE pdrv, const DSEG* seg, UINT nseg, DWORD sector);
+DRESULT disk_writev (BYTE pdrv, const DSEG* seg, UINT nseg, DWORD sector);
+#endif
 
 
 /* Disk Status Bits (DSTATUS) */
@@ -54,6 +74,7 @@ DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 #define CTRL_LOCK			6	/* Lock/Unlock media removal */
 #define CTRL_EJECT			7	/* Eject media */
 #define CTRL_FORMAT			8	/* Create physical format on the media */
+#define CTRL_GET_STATS		9	/* Get number of disk_read/disk_write calls (DSTATS) */
 
 /* MMC/SDC specific ioctl command */
 #define MMC_GET_TYPE		10	/* Get card type */
@@ -43,6 +43,29 @@
 #define MAX_EXFAT	0x7FFFFFFD		/* Max exFAT clusters (differs from specs, implementation limit) */
 
 
+/* Disk access window cache */
+#define WIN_CACHE	(FF_WIN_CACHE > 1 && !FF_FS_TINY)	/* Window is backed by cache buffers */
+
+
+/* Directory read-ahead into the window cache (dir_read) */
+#define DIR_RA		(WIN_CACHE && FF_USE_DISKIOV && (FF_FS_MINIMIZE <= 1 || FF_USE_LABEL || FF_FS_RPATH >= 2))
+
+
+/* Dedicated window for exFAT allocation bitmap */
+#define BM_WIN		(FF_FS_EXFAT && !FF_FS_TINY)
+
+
+/* File buffer pool */
+#define BUF_POOL	(FF_BUF_POOL && !FF_FS_TINY)	/* Files take sector buffers from the pool of the volume */
+#if FF_BUF_POOL > 255
+#error Wrong FF_BUF_POOL setting
+#endif
+
+
+/* File write-behind buffer */
+#define WR_BEHIND	(FF_WRITE_BEHIND && !FF_FS_TINY && !FF_FS_READONLY)	/* Files collect written sectors for multiple sector writes */
+
+
 /* Character code support macros */
 #define IsUpper(c)		((c) >= 'A' && (c) <= 'Z')
 #define IsLower(c)		((c) >= 'a' && (c) <= 'z')
@@ -553,6 +576,9 @@ static const BYTE Dc936[] = TBL_DC936;
 static const BYTE Dc949[] = TBL_DC949;
 static const BYTE Dc950[] = TBL_DC950;
 
+#elif FF_CODE_PAGE == 20127	/* Static code page configuration (ASCII only) */
+#define CODEPAGE FF_CODE_PAGE
+
 #elif FF_CODE_PAGE < 900	/* Static code page configuration (SBCS) */
 #define CODEPAGE FF_CODE_PAGE
 static const BYTE ExCvt[] = MKCVTBL(TBL_CT, FF_CODE_PAGE);
@@ -597,6 +623,16 @@ static DWORD ld_dword (const BYTE* ptr)	/* Load a 4-byte little-endian word */
 	return rv;
 }
 
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+typedef WORD __attribute__((__may_alias__)) AWORD;
+typedef DWORD __attribute__((__may_alias__)) ADWORD;
+#define ld_word_a(ptr)	(*(const AWORD*)(ptr))	/* Load an aligned 2-byte little-endian word by a single access */
+#define ld_dword_a(ptr)	(*(const ADWORD*)(ptr))	/* Load an aligned 4-byte little-endian word by a single access */
+#else
+#define ld_word_a(ptr)	ld_word(ptr)
+#define ld_dword_a(ptr)	ld_dword(ptr)
+#endif
+
 #if FF_FS_EXFAT
 static QWORD ld_qword (const BYTE* ptr)	/* Load an 8-byte little-endian word */
 {
@@ -675,6 +711,20 @@ static void mem_set (void* dst, int val, UINT cnt)
 }
 
 
+#if WIN_CACHE
+/* Exchange memory blocks (both DWORD aligned, cnt is multiple of 4) */
+static void mem_swap (void* dst, void* src, UINT cnt)
+{
+	DWORD *d = (DWORD*)dst, *s = (DWORD*)src, t;
+
+	cnt /= 4;
+	do {
+		t = *d; *d++ = *s; *s++ = t;
+	} while (--cnt);
+}
+#endif
+
+
 /* Compare memory block */
 static int mem_cmp (const void* dst, const void* src, UINT cnt)	/* ZR:same, NZ:different */
 {
@@ -705,7 +755,7 @@ static int dbc_1st (BYTE c)
 		if (c <= DbcTbl[1]) return 1;					/* 1st byte range 1 */
 		if (c >= DbcTbl[2] && c <= DbcTbl[3]) return 1;	/* 1st byte range 2 */
 	}
-#elif FF_CODE_PAGE >= 900	/* DBCS fixed code page */
+#elif FF_CODE_PAGE >= 900 && FF_CODE_PAGE != 20127	/* DBCS fixed code page */
 	if (c >= DbcTbl[0]) {
 		if (c <= DbcTbl[1]) return 1;
 		if (c >= DbcTbl[2] && c <= DbcTbl[3]) return 1;
@@ -726,7 +776,7 @@ static int dbc_2nd (BYTE c)
 		if (c >= DbcTbl[6] && c <= DbcTbl[7]) return 1;	/* 2nd byte range 2 */
 		if (c >= DbcTbl[8] && c <= DbcTbl[9]) return 1;	/* 2nd byte range 3 */
 	}
-#elif FF_CODE_PAGE >= 900	/* DBCS fixed code page */
+#elif FF_CODE_PAGE >= 900 && FF_CODE_PAGE != 20127	/* DBCS fixed code page */
 	if (c >= DbcTbl[4]) {
 		if (c <= DbcTbl[5]) return 1;
 		if (c >= DbcTbl[6] && c <= DbcTbl[7]) return 1;
@@ -1039,6 +1089,20 @@ static void clear_lock (	/* Clear lock entries of the volume */
 /* Move/Flush disk access window in the filesystem object                */
 /*-----------------------------------------------------------------------*/
 #if !FF_FS_READONLY
+static FRESULT write_window (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs,			/* Filesystem object */
+	const BYTE* buf,	/* Sector data */
+	DWORD sect			/* Sector number */
+)
+{
+	if (disk_write(fs->pdrv, buf, sect, 1) != RES_OK) return FR_DISK_ERR;	/* Write back the sector */
+	if (sect - fs->fatbase < fs->fsize) {	/* Is it in the 1st FAT? */
+		if (fs->n_fats == 2) disk_write(fs->pdrv, buf, sect + fs->fsize, 1);	/* Reflect it to 2nd FAT if needed */
+	}
+	return FR_OK;
+}
+
+
 static FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERR */
 	FATFS* fs			/* Filesystem object */
 )
@@ -1047,18 +1111,156 @@ static FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	if (fs->wflag) {	/* Is the disk access window dirty */
-		if (disk_write(fs->pdrv, fs->win, fs->winsect, 1) == RES_OK) {	/* Write back the window */
-			fs->wflag = 0;	/* Clear window dirty flag */
-			if (fs->winsect - fs->fatbase < fs->fsize) {	/* Is it in the 1st FAT? */
-				if (fs->n_fats == 2) disk_write(fs->pdrv, fs->win, fs->winsect + fs->fsize, 1);	/* Reflect it to 2nd FAT if needed */
+		res = write_window(fs, fs->win, fs->winsect);	/* Write back the window */
+		if (res == FR_OK) fs->wflag = 0;	/* Clear window dirty flag */
+	}
+	return res;
+}
+#endif
+
+
+#if WIN_CACHE
+static void reset_cache (
+	FATFS* fs			/* Filesystem object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_WIN_CACHE - 1; i++) {	/* Discard all cached sectors */
+		fs->wcsect[i] = 0xFFFFFFFF;
+		fs->wcflag[i] = 0;
+		fs->wcord[i] = (BYTE)i;
+	}
+}
+
+
+#if !FF_FS_READONLY
+static void drop_cache (
+	FATFS* fs,			/* Filesystem object */
+	DWORD sect,			/* Top of the sectors that are going to be overwritten without the window */
+	DWORD n				/* Number of sectors */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_WIN_CACHE - 1; i++) {	/* Discard stale copies of the sectors */
+		if (fs->wcsect[i] - sect < n) {
+			fs->wcsect[i] = 0xFFFFFFFF;
+			fs->wcflag[i] = 0;
+		}
+	}
+}
+
+
+static FRESULT sync_cache (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs			/* Filesystem object */
+)
+{
+	FRESULT res;
+	UINT i;
+
+
+#if FF_USE_DISKIOV
+	DSEG seg[FF_WIN_CACHE];
+	BYTE bi[FF_WIN_CACHE];
+	UINT n;
+	DWORD sect;
+	int fat;
+
+
+	for (;;) {
+		sect = fs->wflag ? fs->winsect : 0xFFFFFFFF;	/* Find the lowest dirty sector */
+		for (i = 0; i < FF_WIN_CACHE - 1; i++) {
+			if (fs->wcflag[i] && fs->wcsect[i] < sect) sect = fs->wcsect[i];
+		}
+		if (sect == 0xFFFFFFFF) break;		/* All written back? */
+		fat = (sect - fs->fatbase < fs->fsize);
+		for (n = 0; n < FF_WIN_CACHE; n++) {	/* Gather the dirty sectors following it in the same area */
+			if (fat != (sect + n - fs->fatbase < fs->fsize)) break;
+			if (fs->wflag && fs->winsect == sect + n) {
+				i = FF_WIN_CACHE - 1;		/* (It is in the window) */
+				seg[n].buff = fs->win;
+			} else {
+				for (i = 0; i < FF_WIN_CACHE - 1 && !(fs->wcflag[i] && fs->wcsect[i] == sect + n); i++) ;
+				if (i == FF_WIN_CACHE - 1) break;
+				seg[n].buff = fs->wcbuf[i];
 			}
-		} else {
-			res = FR_DISK_ERR;
+			seg[n].count = 1; bi[n] = (BYTE)i;
+		}
+		if (disk_writev(fs->pdrv, seg, n, sect) != RES_OK) return FR_DISK_ERR;	/* Write them back by a request */
+		if (fat && fs->n_fats == 2) disk_writev(fs->pdrv, seg, n, sect + fs->fsize);	/* Reflect them to 2nd FAT if needed */
+		while (n) {		/* Clear dirty flags */
+			i = bi[--n];
+			if (i == FF_WIN_CACHE - 1) {
+				fs->wflag = 0;
+			} else {
+				fs->wcflag[i] = 0;
+			}
+		}
+	}
+	res = FR_OK;
+#else
+	res = sync_window(fs);
+	for (i = 0; res == FR_OK && i < FF_WIN_CACHE - 1; i++) {	/* Write back dirty cache buffers */
+		if (fs->wcflag[i]) {
+			res = write_window(fs, fs->wcbuf[i], fs->wcsect[i]);
+			if (res == FR_OK) fs->wcflag[i] = 0;
 		}
 	}
+#endif
 	return res;
 }
 #endif
+#endif
+
+
+#if BM_WIN
+/*-----------------------------------------------------------------------*/
+/* Move/Flush the allocation bitmap window (exFAT)                       */
+/*-----------------------------------------------------------------------*/
+/* The allocation bitmap has its own window, so that scanning and changing
+/  it does not push FAT and directory sectors out of the disk access window
+/  and the bitmap sector being allocated from stays in the memory. */
+
+#if !FF_FS_READONLY
+static FRESULT sync_bitmap (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs			/* Filesystem object */
+)
+{
+	if (fs->bmflag) {	/* Is the bitmap window dirty? */
+		if (disk_write(fs->pdrv, fs->bmwin, fs->bmsect, 1) != RES_OK) return FR_DISK_ERR;
+		fs->bmflag = 0;
+	}
+	return FR_OK;
+}
+
+
+static FRESULT move_bitmap (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs,			/* Filesystem object */
+	DWORD sector		/* Bitmap sector number to make appearance in the fs->bmwin[] */
+)
+{
+	if (sector != fs->bmsect) {	/* Window offset changed? */
+		if (sync_bitmap(fs) != FR_OK) return FR_DISK_ERR;	/* Write-back changes */
+		if (disk_read(fs->pdrv, fs->bmwin, sector, 1) != RES_OK) {
+			fs->bmsect = 0xFFFFFFFF;	/* Invalidate window if read data is not valid */
+			return FR_DISK_ERR;
+		}
+		fs->bmsect = sector;
+	}
+	return FR_OK;
+}
+#endif	/* !FF_FS_READONLY */
+
+#define BMWIN(fs)	((fs)->bmwin)
+#define BMDIRTY(fs)	((fs)->bmflag = 1)
+#else
+#define move_bitmap(fs, sector)	move_window(fs, sector)
+#define BMWIN(fs)	((fs)->win)
+#define BMDIRTY(fs)	((fs)->wflag = 1)
+#endif	/* BM_WIN */
 
 
 static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
@@ -1067,10 +1269,37 @@ static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 )
 {
 	FRESULT res = FR_OK;
+#if WIN_CACHE
+	UINT i, b;
+	DWORD ws;
+	BYTE wf;
+#endif
 
 
 	if (sector != fs->winsect) {	/* Window offset changed? */
+#if WIN_CACHE
+		for (i = 0; i < FF_WIN_CACHE - 2 && fs->wcsect[fs->wcord[i]] != sector; i++) ;	/* Find the sector or take the least recently used buffer */
+		b = fs->wcord[i];
 #if !FF_FS_READONLY
+		if (fs->wcsect[b] != sector && fs->wcflag[b]) {	/* Write back the buffer to be reused if it is dirty */
+			res = write_window(fs, fs->wcbuf[b], fs->wcsect[b]);
+			if (res != FR_OK) return res;
+			fs->wcflag[b] = 0;
+		}
+#endif
+		for ( ; i > 0; i--) fs->wcord[i] = fs->wcord[i - 1];	/* Make it the most recently used buffer */
+		fs->wcord[0] = (BYTE)b;
+		ws = fs->winsect; wf = fs->wflag;
+		if (fs->wcsect[b] == sector) {	/* Cache hit: exchange the window and the buffer */
+			mem_swap(fs->win, fs->wcbuf[b], SS(fs));
+			fs->winsect = sector; fs->wflag = fs->wcflag[b];
+			fs->wcsect[b] = ws; fs->wcflag[b] = wf;
+			return FR_OK;
+		}
+		mem_cpy(fs->wcbuf[b], fs->win, SS(fs));	/* Keep the current window (and its dirty state) in the buffer */
+		fs->wcsect[b] = ws; fs->wcflag[b] = wf;
+		fs->wflag = 0;
+#elif !FF_FS_READONLY
 		res = sync_window(fs);		/* Write-back changes */
 #endif
 		if (res == FR_OK) {			/* Fill sector window with new data */
@@ -1085,6 +1314,56 @@ static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 }
 
 
+#if DIR_RA
+/*-----------------------------------------------------------------------*/
+/* Read directory sectors ahead into the window cache                    */
+/*-----------------------------------------------------------------------*/
+/* When a directory is read in sequence and its current sector is not in the
+/  memory, the sector and the following ones in the same cluster are read by a
+/  request into the clean cache buffers, so that dir_read finds them in the
+/  cache instead of reading each sector. */
+
+static void dir_readahead (
+	DIR* dp				/* Directory object to read ahead for */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	DWORD sect = dp->sect, n;
+	DSEG seg[FF_WIN_CACHE - 1];
+	BYTE bi[FF_WIN_CACHE - 1];
+	UINT i, j, k;
+
+
+	if (sect == 0 || sect == fs->winsect) return;
+	if (dp->clust == 0) {	/* Static table (FAT12/16 root directory) */
+		n = fs->dirbase + fs->n_rootdir / (SS(fs) / SZDIRE) - sect;
+	} else {				/* Dynamic table */
+		n = fs->csize - (sect - fs->database) % fs->csize;
+	}
+	if (fs->winsect - sect < n) n = fs->winsect - sect;		/* Stop at the sectors already in the window or cache */
+	for (i = 0; i < FF_WIN_CACHE - 1; i++) {
+		if (fs->wcsect[i] - sect < n) n = fs->wcsect[i] - sect;
+	}
+	for (i = FF_WIN_CACHE - 1, k = 0; i > 0 && k < n; i--) {	/* Take clean buffers from the least recently used one */
+		j = fs->wcord[i - 1];
+		if (!fs->wcflag[j]) {
+			bi[k] = (BYTE)j; seg[k].buff = fs->wcbuf[j]; seg[k].count = 1;
+			fs->wcsect[j] = 0xFFFFFFFF;
+			k++;
+		}
+	}
+	if (k < 2) return;		/* Nothing to read ahead (the sector will be read by move_window) */
+	if (disk_readv(fs->pdrv, seg, k, sect) != RES_OK) return;	/* (The error is left to move_window) */
+	for (i = 0; i < k; i++) fs->wcsect[bi[i]] = sect + i;
+	for (i = j = 0; i < FF_WIN_CACHE - 1; i++) {	/* Put the buffers in order of the sectors at the top of the use order */
+		if (fs->wcsect[fs->wcord[i]] - sect >= k) fs->wcord[j++] = fs->wcord[i];
+	}
+	for (i = FF_WIN_CACHE - 1; j > 0; ) fs->wcord[--i] = fs->wcord[--j];
+	for (i = 0; i < k; i++) fs->wcord[i] = bi[i];
+}
+#endif
+
+
 
 
 #if !FF_FS_READONLY
@@ -1099,7 +1378,15 @@ static FRESULT sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 	FRESULT res;
 
 
+#if BM_WIN
+	res = sync_bitmap(fs);	/* Allocation bitmap goes first, then the FAT and directory */
+	if (res == FR_OK)
+#endif
+#if WIN_CACHE
+	res = sync_cache(fs);
+#else
 	res = sync_window(fs);
+#endif
 	if (res == FR_OK) {
 		if (fs->fs_type == FS_FAT32 && fs->fsi_flag == 1) {	/* FAT32: Update FSInfo sector if needed */
 			/* Create FSInfo structure */
@@ -1111,6 +1398,9 @@ static FRESULT sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 			st_dword(fs->win + FSI_Nxt_Free, fs->last_clst);
 			/* Write it into the FSInfo sector */
 			fs->winsect = fs->volbase + 1;
+#if WIN_CACHE
+			drop_cache(fs, fs->winsect, 1);
+#endif
 			disk_write(fs->pdrv, fs->win, fs->winsect, 1);
 			fs->fsi_flag = 0;
 		}
@@ -1121,6 +1411,30 @@ static FRESULT sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 	return res;
 }
 
+
+#if FF_SYNC_POLICY || FF_USE_REPLACE
+static FRESULT flush_fs (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	FRESULT res;
+
+
+	/* Same as sync_fs() but the FSInfo is left for a later sync_fs() */
+#if BM_WIN
+	res = sync_bitmap(fs);
+	if (res == FR_OK)
+#endif
+#if WIN_CACHE
+	res = sync_cache(fs);
+#else
+	res = sync_window(fs);
+#endif
+	if (res == FR_OK && disk_ioctl(fs->pdrv, CTRL_SYNC, 0) != RES_OK) res = FR_DISK_ERR;
+	return res;
+}
+#endif
+
 #endif
 
 
@@ -1142,6 +1456,191 @@ static DWORD clst2sect (	/* !=0:Sector number, 0:Failed (invalid cluster#) */
 
 
 
+#if !FF_FS_READONLY && FF_FAT_MAP_SIZE
+/*-----------------------------------------------------------------------*/
+/* Free cluster map - Mark/Test cluster groups without free clusters     */
+/*-----------------------------------------------------------------------*/
+
+static void fmap_init (
+	FATFS* fs		/* Filesystem object */
+)
+{
+	for (fs->fmshift = 0; (fs->n_fatent - 1) >> fs->fmshift >= FF_FAT_MAP_SIZE * 8; fs->fmshift++) ;	/* Fit all groups into the map */
+	mem_set(fs->fmap, 0, FF_FAT_MAP_SIZE);	/* Any group may have free clusters */
+}
+
+
+static void fmap_put (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* A cluster in the group */
+	int full		/* 1:Group has no free cluster, 0:Group has free cluster(s) */
+)
+{
+	DWORD grp = clst >> fs->fmshift;
+
+	if (full) {
+		fs->fmap[grp / 8] |= (BYTE)(1 << (grp % 8));
+	} else {
+		fs->fmap[grp / 8] &= (BYTE)~(1 << (grp % 8));
+	}
+}
+
+
+static int fmap_full (	/* 1:Group has no free cluster, 0:It might have */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* A cluster in the group */
+)
+{
+	DWORD grp = clst >> fs->fmshift;
+
+	return (fs->fmap[grp / 8] >> (grp % 8)) & 1;
+}
+
+#endif	/* !FF_FS_READONLY && FF_FAT_MAP_SIZE */
+
+
+
+
+#if BUF_POOL
+/*-----------------------------------------------------------------------*/
+/* File buffer pool - Check/Take/Release the sector buffer of a file     */
+/*-----------------------------------------------------------------------*/
+
+static void reset_pool (
+	FATFS* fs		/* Filesystem object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_BUF_POOL; i++) {	/* All buffers are free */
+		fs->fbown[i] = 0;
+		fs->fbord[i] = (BYTE)i;
+	}
+}
+
+
+static void check_buf (
+	FIL* fp			/* File object */
+)
+{
+	FATFS *fs = fp->obj.fs;
+
+
+	if (fp->buf && fs->fbown[(fp->buf - fs->fbuf[0]) / FF_MAX_SS] != fp) {	/* Has the buffer been taken by another file? */
+		fp->buf = 0;					/* The data have been written back by the file that took it */
+		fp->flag &= (BYTE)~FA_DIRTY;
+	}
+	if (!fp->buf && fp->fptr % SS(fs) == 0) fp->sect = 0;	/* No sector to reload on the sector boundary */
+}
+
+
+static FRESULT take_buf (	/* FR_OK or FR_DISK_ERR */
+	FIL* fp,		/* File object */
+	DWORD sect		/* Sector to be loaded into a newly taken buffer (0:none) */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	FIL *ow;
+	UINT i, b;
+
+
+	check_buf(fp);
+	if (fp->buf) {		/* The file has a buffer */
+		b = (UINT)((fp->buf - fs->fbuf[0]) / FF_MAX_SS);
+		for (i = 0; fs->fbord[i] != b; i++) ;
+	} else {			/* Take the least recently used buffer */
+		i = FF_BUF_POOL - 1;
+		b = fs->fbord[i];
+#if !FF_FS_READONLY
+		ow = (FIL*)fs->fbown[b];
+		if (ow && ow->obj.fs == fs && ow->obj.id == fs->id && ow->buf == fs->fbuf[b] && (ow->flag & FA_DIRTY)) {	/* Write back the data of its owner */
+			if (disk_write(fs->pdrv, fs->fbuf[b], ow->sect, 1) != RES_OK) return FR_DISK_ERR;
+		}
+#else
+		(void)ow;
+#endif
+		fs->fbown[b] = fp;
+		fp->buf = fs->fbuf[b];
+		if (sect != 0) {		/* Reload the sector the file pointer is in */
+			if (disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) {
+				fs->fbown[b] = 0; fp->buf = 0;
+				return FR_DISK_ERR;
+			}
+		} else {
+			mem_set(fp->buf, 0, SS(fs));	/* Clear sector buffer */
+		}
+		fp->sect = sect;
+	}
+	for ( ; i > 0; i--) fs->fbord[i] = fs->fbord[i - 1];	/* Make it the most recently used */
+	fs->fbord[0] = (BYTE)b;
+	return FR_OK;
+}
+
+
+static void free_buf (
+	FIL* fp			/* File object */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	UINT i, b;
+
+
+	check_buf(fp);
+	if (fp->buf) {
+		b = (UINT)((fp->buf - fs->fbuf[0]) / FF_MAX_SS);
+		for (i = 0; fs->fbord[i] != b; i++) ;
+		for ( ; i < FF_BUF_POOL - 1; i++) fs->fbord[i] = fs->fbord[i + 1];	/* Make it the first to be taken */
+		fs->fbord[i] = (BYTE)b;
+		fs->fbown[b] = 0;
+		fp->buf = 0;
+	}
+}
+
+#endif	/* BUF_POOL */
+
+
+
+
+#if WR_BEHIND
+/*-----------------------------------------------------------------------*/
+/* File write-behind buffer - Collect/Flush the written sectors of a file */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT flush_wb (	/* FR_OK or FR_DISK_ERR */
+	FIL* fp			/* File object */
+)
+{
+	FATFS *fs = fp->obj.fs;
+
+
+	if (fp->wbcnt != 0) {	/* Write the collected sectors in a multiple sector write */
+		if (disk_write(fs->pdrv, fp->wbuf, fp->wbsect, fp->wbcnt) != RES_OK) return FR_DISK_ERR;
+		fp->wbcnt = 0;
+	}
+	return FR_OK;
+}
+
+
+static FRESULT put_wb (	/* FR_OK or FR_DISK_ERR */
+	FIL* fp			/* File object with the dirty sector buffer */
+)
+{
+	if (fp->wbcnt != 0 && fp->sect != fp->wbsect + fp->wbcnt) {	/* Does not the sector follow the collected ones? */
+		if (flush_wb(fp) != FR_OK) return FR_DISK_ERR;
+	}
+	if (fp->wbcnt == 0) fp->wbsect = fp->sect;
+	mem_cpy(fp->wbuf + fp->wbcnt * SS(fp->obj.fs), fp->buf, SS(fp->obj.fs));	/* Collect the sector */
+	fp->wbcnt++;
+	fp->flag &= (BYTE)~FA_DIRTY;
+	return (fp->wbcnt == fp->wbsz) ? flush_wb(fp) : FR_OK;	/* Write them out when the buffer is full */
+}
+
+#endif	/* WR_BEHIND */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT access - Read value of a FAT entry                                */
 /*-----------------------------------------------------------------------*/
@@ -1218,28 +1717,86 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 
 
 
-#if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
-/* FAT access - Change value of a FAT entry                              */
+/* FAT access - Get a run of contiguous clusters in the chain            */
 /*-----------------------------------------------------------------------*/
 
-static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
-	FATFS* fs,		/* Corresponding filesystem object */
-	DWORD clst,		/* FAT index number (cluster number) to be changed */
-	DWORD val		/* New value to be set to the entry */
+static DWORD get_run (	/* Number of clusters in the run (clst..clst+n-1) */
+	FFOBJID* obj,	/* Corresponding object */
+	DWORD clst,		/* First cluster of the run */
+	DWORD max,		/* Max number of clusters to resolve (>=1) */
+	DWORD* nxt		/* Returns value of the last cluster in the run (same as get_fat) */
 )
 {
-	UINT bc;
-	BYTE *p;
-	FRESULT res = FR_INT_ERR;
+	UINT ofs, esz;
+	DWORD val, n = 0;
+	FATFS *fs = obj->fs;
 
 
-	if (clst >= 2 && clst < fs->n_fatent) {	/* Check if in valid range */
-		switch (fs->fs_type) {
-		case FS_FAT12 :
-			bc = (UINT)clst; bc += bc / 2;	/* bc: byte offset of the entry */
-			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
-			if (res != FR_OK) break;
+	if (clst < 2 || clst >= fs->n_fatent) {	/* Check if in valid range */
+		*nxt = 1;	/* Internal error */
+		return 1;
+	}
+	switch (fs->fs_type) {
+	case FS_FAT16 :
+	case FS_FAT32 :		/* Scan the entries in the FAT sector without per-entry window check */
+		esz = (fs->fs_type == FS_FAT16) ? 2 : 4;	/* Size of FAT entry */
+		for (;;) {
+			if (move_window(fs, fs->fatbase + clst / (SS(fs) / esz)) != FR_OK) {
+				val = 0xFFFFFFFF; n++;	/* Disk error */
+				break;
+			}
+			ofs = clst * esz % SS(fs);
+			do {
+				val = (esz == 2) ? ld_word_a(fs->win + ofs) : ld_dword_a(fs->win + ofs) & 0x0FFFFFFF;
+				ofs += esz; n++;
+			} while (val == ++clst && n < max && ofs < SS(fs) && clst < fs->n_fatent);	/* While it links to the following entry in the sector */
+			if (val != clst || n >= max || clst >= fs->n_fatent) break;	/* End of the run? */
+		}
+		break;
+
+	default :			/* FAT12 and exFAT (may have no FAT chain) */
+		do {
+			val = get_fat(obj, clst);
+			n++;
+		} while (val == ++clst && n < max && clst < fs->n_fatent);
+	}
+
+	*nxt = val;
+	return n;
+}
+
+
+
+
+#if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* FAT access - Change value of a FAT entry                              */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,		/* Corresponding filesystem object */
+	DWORD clst,		/* FAT index number (cluster number) to be changed */
+	DWORD val		/* New value to be set to the entry */
+)
+{
+	UINT bc;
+	BYTE *p;
+	FRESULT res = FR_INT_ERR;
+
+
+	if (clst >= 2 && clst < fs->n_fatent) {	/* Check if in valid range */
+#if FF_FAT_MAP_SIZE
+		if (val == 0 && fs->fs_type != FS_EXFAT) fmap_put(fs, clst, 0);	/* The group has a free cluster now */
+#endif
+#if FF_USE_CHKVOL
+		fs->chk_gen++;		/* The FAT has been changed */
+#endif
+		switch (fs->fs_type) {
+		case FS_FAT12 :
+			bc = (UINT)clst; bc += bc / 2;	/* bc: byte offset of the entry */
+			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
+			if (res != FR_OK) break;
 			p = fs->win + bc++ % SS(fs);
 			*p = (clst & 1) ? ((*p & 0x0F) | ((BYTE)val << 4)) : (BYTE)val;		/* Put 1st byte */
 			fs->wflag = 1;
@@ -1279,6 +1836,36 @@ static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 
 
 
+#if FF_USE_CHKVOL && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Account allocation changes in the free cluster count   */
+/*-----------------------------------------------------------------------*/
+/* f_chknext counts the free clusters in slices. The clusters allocated or
+/  freed in between are accounted here if the count has passed them. */
+
+static void scan_adjust (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* First cluster of the block allocated or freed */
+	DWORD ncl,		/* Number of clusters in the block */
+	int fr			/* 1:Freed, 0:Allocated */
+)
+{
+	if (clst < fs->scan_clst) {	/* Has the block been counted? */
+		if (ncl > fs->scan_clst - clst) ncl = fs->scan_clst - clst;
+		if (fr) {
+			fs->scan_free += ncl;
+			fs->scan_gfree = 1;	/* The group being counted may have a free cluster now */
+		} else {
+			fs->scan_free -= ncl;
+		}
+	}
+}
+
+#endif	/* FF_USE_CHKVOL && !FF_FS_READONLY */
+
+
+
+
 #if FF_FS_EXFAT && !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* exFAT: Accessing FAT and Allocation Bitmap                            */
@@ -1303,11 +1890,11 @@ static DWORD find_bitmap (	/* 0:Not found, 2..:Cluster block found, 0xFFFFFFFF:D
 	if (clst >= fs->n_fatent - 2) clst = 0;
 	scl = val = clst; ctr = 0;
 	for (;;) {
-		if (move_window(fs, fs->bitbase + val / 8 / SS(fs)) != FR_OK) return 0xFFFFFFFF;
+		if (move_bitmap(fs, fs->bitbase + val / 8 / SS(fs)) != FR_OK) return 0xFFFFFFFF;
 		i = val / 8 % SS(fs); bm = 1 << (val % 8);
 		do {
 			do {
-				bv = fs->win[i] & bm; bm <<= 1;		/* Get bit value */
+				bv = BMWIN(fs)[i] & bm; bm <<= 1;		/* Get bit value */
 				if (++val >= fs->n_fatent - 2) {	/* Next cluster (with wrap-around) */
 					val = 0; bm = 0; i = SS(fs);
 				}
@@ -1345,12 +1932,12 @@ static FRESULT change_bitmap (
 	i = clst / 8 % SS(fs);					/* Byte offset in the sector */
 	bm = 1 << (clst % 8);					/* Bit mask in the byte */
 	for (;;) {
-		if (move_window(fs, sect++) != FR_OK) return FR_DISK_ERR;
+		if (move_bitmap(fs, sect++) != FR_OK) return FR_DISK_ERR;
 		do {
 			do {
-				if (bv == (int)((fs->win[i] & bm) != 0)) return FR_INT_ERR;	/* Is the bit expected value? */
-				fs->win[i] ^= bm;	/* Flip the bit */
-				fs->wflag = 1;
+				if (bv == (int)((BMWIN(fs)[i] & bm) != 0)) return FR_INT_ERR;	/* Is the bit expected value? */
+				BMWIN(fs)[i] ^= bm;	/* Flip the bit */
+				BMDIRTY(fs);
 				if (--ncl == 0) return FR_OK;	/* All bits processed? */
 			} while (bm <<= 1);		/* Next bit */
 			bm = 1;
@@ -1420,11 +2007,8 @@ static FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 )
 {
 	FRESULT res = FR_OK;
-	DWORD nxt;
+	DWORD nxt, ncl, cl;
 	FATFS *fs = obj->fs;
-#if FF_FS_EXFAT || FF_USE_TRIM
-	DWORD scl = clst, ecl = clst;
-#endif
 #if FF_USE_TRIM
 	DWORD rt[2];
 #endif
@@ -1439,38 +2023,37 @@ static FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 
 	/* Remove the chain */
 	do {
-		nxt = get_fat(obj, clst);			/* Get cluster status */
-		if (nxt == 0) break;				/* Empty cluster? */
+		ncl = get_run(obj, clst, fs->n_fatent, &nxt);	/* Get a block of contiguous clusters and the link from it */
 		if (nxt == 1) return FR_INT_ERR;	/* Internal error? */
 		if (nxt == 0xFFFFFFFF) return FR_DISK_ERR;	/* Disk error? */
+		if (nxt == 0) ncl--;				/* Is the last one an empty cluster? */
+		if (ncl == 0) break;
 		if (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) {
-			res = put_fat(fs, clst, 0);		/* Mark the cluster 'free' on the FAT */
-			if (res != FR_OK) return res;
+			for (cl = clst; cl < clst + ncl; cl++) {
+				res = put_fat(fs, cl, 0);	/* Mark the cluster 'free' on the FAT */
+				if (res != FR_OK) return res;
+			}
 		}
 		if (fs->free_clst < fs->n_fatent - 2) {	/* Update FSINFO */
-			fs->free_clst++;
+			fs->free_clst = (fs->free_clst + ncl < fs->n_fatent - 2) ? fs->free_clst + ncl : fs->n_fatent - 2;
 			fs->fsi_flag |= 1;
 		}
-#if FF_FS_EXFAT || FF_USE_TRIM
-		if (ecl + 1 == nxt) {	/* Is next cluster contiguous? */
-			ecl = nxt;
-		} else {				/* End of contiguous cluster block */
+#if FF_USE_CHKVOL
+		scan_adjust(fs, clst, ncl, 1);
+#endif
 #if FF_FS_EXFAT
-			if (fs->fs_type == FS_EXFAT) {
-				res = change_bitmap(fs, scl, ecl - scl + 1, 0);	/* Mark the cluster block 'free' on the bitmap */
-				if (res != FR_OK) return res;
-			}
+		if (fs->fs_type == FS_EXFAT) {
+			res = change_bitmap(fs, clst, ncl, 0);	/* Mark the cluster block 'free' on the bitmap */
+			if (res != FR_OK) return res;
+		}
 #endif
 #if FF_USE_TRIM
-			rt[0] = clst2sect(fs, scl);					/* Start of data area freed */
-			rt[1] = clst2sect(fs, ecl) + fs->csize - 1;	/* End of data area freed */
-			disk_ioctl(fs->pdrv, CTRL_TRIM, rt);		/* Inform device the data in the block is no longer needed */
+		rt[0] = clst2sect(fs, clst);					/* Start of data area freed */
+		rt[1] = clst2sect(fs, clst + ncl - 1) + fs->csize - 1;	/* End of data area freed */
+		disk_ioctl(fs->pdrv, CTRL_TRIM, rt);		/* Inform device the data in the block is no longer needed */
 #endif
-			scl = ecl = nxt;
-		}
-#endif
-		clst = nxt;					/* Next cluster */
-	} while (clst < fs->n_fatent);	/* Repeat while not the last link */
+		clst = nxt;					/* Next block */
+	} while (clst >= 2 && clst < fs->n_fatent);	/* Repeat while not the last link */
 
 #if FF_FS_EXFAT
 	/* Some post processes for chain status */
@@ -1504,6 +2087,53 @@ static FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 
 
 
+#if FF_FAT_MAP_SIZE
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Find a free cluster skipping groups known to be full   */
+/*-----------------------------------------------------------------------*/
+
+static DWORD find_free_clust (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:Free cluster# */
+	FFOBJID* obj,		/* Corresponding object */
+	DWORD scl			/* Cluster# to start to find after */
+)
+{
+	FATFS *fs = obj->fs;
+	DWORD ncl, cs, skip, gmsk, cnt;
+	int whole = 0;		/* The group is being checked from its top */
+
+
+	gmsk = ((DWORD)1 << fs->fmshift) - 1;	/* Cluster group mask */
+	cnt = fs->n_fatent - 2;					/* Number of clusters to check */
+	ncl = scl;
+	while (cnt) {
+		ncl++;									/* Next cluster */
+		if (ncl >= fs->n_fatent) ncl = 2;		/* Wrap-around */
+		if (ncl == 2 || (ncl & gmsk) == 0) {	/* Top of a group? */
+			whole = 1;
+			if (fmap_full(fs, ncl)) {			/* Skip the group known to have no free cluster */
+				skip = (ncl | gmsk) + 1 - ncl;
+				if (ncl + skip > fs->n_fatent) skip = fs->n_fatent - ncl;
+				if (skip >= cnt) return 0;
+				cnt -= skip; ncl += skip - 1;
+				continue;
+			}
+		}
+		cs = get_fat(obj, ncl);					/* Get the cluster status */
+		if (cs == 0) return ncl;				/* Found a free cluster? */
+		if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
+		cnt--;
+		if (whole && ((ncl & gmsk) == gmsk || ncl == fs->n_fatent - 1)) {
+			fmap_put(fs, ncl, 1);				/* Entire group has been checked and there is no free cluster */
+		}
+	}
+	return 0;
+}
+
+#endif	/* FF_FAT_MAP_SIZE */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Stretch a chain or Create a new chain                  */
 /*-----------------------------------------------------------------------*/
@@ -1571,6 +2201,10 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 			}
 		}
 		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
+#if FF_FAT_MAP_SIZE
+			ncl = find_free_clust(obj, scl);
+			if (ncl < 2 || ncl == 0xFFFFFFFF) return ncl;	/* No free cluster or error? */
+#else
 			ncl = scl;	/* Start cluster */
 			for (;;) {
 				ncl++;							/* Next cluster */
@@ -1583,6 +2217,7 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 				if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
 				if (ncl == scl) return 0;		/* No free cluster found? */
 			}
+#endif
 		}
 		res = put_fat(fs, ncl, 0xFFFFFFFF);		/* Mark the new cluster 'EOC' */
 		if (res == FR_OK && clst != 0) {
@@ -1594,6 +2229,9 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 		fs->last_clst = ncl;
 		if (fs->free_clst <= fs->n_fatent - 2) fs->free_clst--;
 		fs->fsi_flag |= 1;
+#if FF_USE_CHKVOL
+		scan_adjust(fs, ncl, 1, 0);
+#endif
 	} else {
 		ncl = (res == FR_DISK_ERR) ? 0xFFFFFFFF : 1;	/* Failed. Generate error status */
 	}
@@ -1636,6 +2274,116 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 
 
+#if FF_FILE_EXTENTS
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Cache and look up extents of the file                  */
+/*-----------------------------------------------------------------------*/
+
+static void ext_put (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD ci,		/* Index of the first cluster in the file */
+	DWORD clst,		/* First cluster */
+	DWORD ncl		/* Number of contiguous clusters */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_FILE_EXTENTS; i++) {	/* Extend the entry the clusters belong to or follow */
+		if (fp->xncl[i] != 0 && ci - fp->xcidx[i] <= fp->xncl[i] && clst == fp->xclst[i] + (ci - fp->xcidx[i])) {
+			if (ci + ncl - fp->xcidx[i] > fp->xncl[i]) fp->xncl[i] = ci + ncl - fp->xcidx[i];
+			return;
+		}
+	}
+	i = fp->xnext;			/* Replace an entry in round robin */
+	fp->xnext = (BYTE)((i + 1) % FF_FILE_EXTENTS);
+	fp->xcidx[i] = ci; fp->xclst[i] = clst; fp->xncl[i] = ncl;
+}
+
+
+static DWORD ext_clust (	/* 0:Not in the cache, >=2:Cluster number */
+	FIL* fp,		/* Pointer to the file object */
+	DWORD ci		/* Index of the cluster in the file */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_FILE_EXTENTS; i++) {
+		if (ci - fp->xcidx[i] < fp->xncl[i]) return fp->xclst[i] + (ci - fp->xcidx[i]);
+	}
+	return 0;
+}
+
+
+#if FF_FS_MINIMIZE <= 2
+static DWORD ext_near (	/* 0:Nothing is cached, >=2:Cluster number */
+	FIL* fp,		/* Pointer to the file object */
+	DWORD* ci		/* Index of the cluster in the file [IN], index of the returned cluster (<= [IN]) [OUT] */
+)
+{
+	UINT i;
+	DWORD k, ki = 0, clst = 0;
+
+
+	for (i = 0; i < FF_FILE_EXTENTS; i++) {	/* Find the closest cached cluster at or before the cluster */
+		if (fp->xncl[i] != 0 && fp->xcidx[i] <= *ci) {
+			k = (*ci - fp->xcidx[i] < fp->xncl[i]) ? *ci : fp->xcidx[i] + fp->xncl[i] - 1;
+			if (clst == 0 || k > ki) {
+				ki = k; clst = fp->xclst[i] + (k - fp->xcidx[i]);
+			}
+		}
+	}
+	*ci = ki;
+	return clst;
+}
+#endif
+
+
+static DWORD ext_next (	/* Same as get_fat */
+	FIL* fp			/* Pointer to the file object on the cluster boundary (fptr > 0) */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	DWORD ci, clst, max, ncl;
+
+
+	ci = (DWORD)(fp->fptr / SS(fs) / fs->csize);	/* Index of the next cluster */
+	clst = ext_clust(fp, ci);
+	if (clst != 0) return clst;		/* Hit in the cache */
+
+	max = (DWORD)((fp->obj.objsize - 1) / SS(fs) / fs->csize) - ci + 2;	/* Clusters from current one to the last one of the file */
+	if (max > SS(fs)) max = SS(fs);	/* Do not go too far at once */
+	ncl = get_run(&fp->obj, fp->clust, max, &clst);	/* Follow the chain by a run of clusters */
+	ext_put(fp, ci - 1, fp->clust, ncl);
+	if (ncl > 1) return fp->clust + 1;
+	if (clst >= 2 && clst < fs->n_fatent) ext_put(fp, ci, clst, 1);
+	return clst;
+}
+
+
+static void ext_cut (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD ncl		/* Number of clusters remaining in the file */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_FILE_EXTENTS; i++) {	/* Drop the clusters removed from the file */
+		if (fp->xcidx[i] >= ncl) {
+			fp->xncl[i] = 0;
+		} else if (fp->xncl[i] > ncl - fp->xcidx[i]) {
+			fp->xncl[i] = ncl - fp->xcidx[i];
+		}
+	}
+}
+
+#endif	/* FF_FILE_EXTENTS */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Fill a cluster with zeros                        */
 /*-----------------------------------------------------------------------*/
@@ -1654,7 +2402,13 @@ static FRESULT dir_clear (	/* Returns FR_OK or FR_DISK_ERR */
 	if (sync_window(fs) != FR_OK) return FR_DISK_ERR;	/* Flush disk access window */
 	sect = clst2sect(fs, clst);		/* Top of the cluster */
 	fs->winsect = sect;				/* Set window to top of the cluster */
+#if WIN_CACHE
+	drop_cache(fs, sect, fs->csize);	/* Discard cached copies of the cluster */
+#endif
 	mem_set(fs->win, 0, sizeof fs->win);	/* Clear window buffer */
+#if FF_DIR_INDEX
+	if (fs->dix_clst == clst) fs->dix_stat = 0;	/* Indexed directory has been removed and the cluster is reused */
+#endif
 #if FF_USE_LFN == 3		/* Quick table clear by using multi-secter write */
 	/* Allocate a temporary buffer */
 	for (szb = ((DWORD)fs->csize * SS(fs) >= MAX_MALLOC) ? MAX_MALLOC : fs->csize * SS(fs), ibuf = 0; szb > SS(fs) && (ibuf = ff_memalloc(szb)) == 0; szb /= 2) ;
@@ -1864,6 +2618,27 @@ static void st_clust (
 
 
 #if FF_USE_LFN
+/*-----------------------------------------------------------------------*/
+/* LFN: Up-case conversion for name comparison                           */
+/*-----------------------------------------------------------------------*/
+/* Names are compared with ASCII characters folded in pairs: two UTF-16  */
+/* characters are packed into a DWORD and the lanes in 'a'-'z' are found */
+/* by carries into bit 7 of each lane, so the up-case table is consulted */
+/* only for non-ASCII characters.                                        */
+
+#define IsAscii2(dw)	(((dw) & 0xFF80FF80) == 0)	/* Are both characters in the DWORD ASCII? */
+#define UpAscii2(dw)	((dw) - ((((dw) + 0x001F001F) & ~((dw) + 0x00050005) & 0x00800080) >> 2))	/* Up-case conversion of two ASCII characters */
+
+static WCHAR up_wchar (	/* Returns up-case character */
+	WCHAR wc			/* Character to be converted */
+)
+{
+	if (wc < 0x80) return IsLower(wc) ? wc - 0x20 : wc;	/* ASCII */
+	return (WCHAR)ff_wtoupper(wc);
+}
+
+
+
 /*--------------------------------------------------------*/
 /* FAT-LFN: Compare a part of file name with an LFN entry */
 /*--------------------------------------------------------*/
@@ -1875,6 +2650,7 @@ static int cmp_lfn (		/* 1:matched, 0:not matched */
 {
 	UINT i, s;
 	WCHAR wc, uc;
+	DWORD d, n;
 
 
 	if (ld_word(dir + LDIR_FstClusLO) != 0) return 0;	/* Check LDIR_FstClusLO */
@@ -1882,9 +2658,18 @@ static int cmp_lfn (		/* 1:matched, 0:not matched */
 	i = ((dir[LDIR_Ord] & 0x3F) - 1) * 13;	/* Offset in the LFN buffer */
 
 	for (wc = 1, s = 0; s < 13; s++) {		/* Process all characters in the entry */
+		if (wc != 0 && ((s < 4) ^ (s & 1)) && i + 1 < FF_MAX_LFN) {	/* Are two characters adjacent in the entry (0-1, 2-3, 5-6, 7-8, 9-10, 11-12)? */
+			d = ld_dword(dir + LfnOfs[s]);				/* Pick two LFN characters */
+			n = lfnbuf[i] | (DWORD)lfnbuf[i + 1] << 16;	/* and two characters of the name */
+			if (IsAscii2(d | n) && (d & 0xFFFF) && (d >> 16)) {	/* Both ASCII and not the terminator? */
+				if (UpAscii2(d) != UpAscii2(n)) return 0;		/* Compare them at a time */
+				i += 2; s++;
+				continue;
+			}
+		}
 		uc = ld_word(dir + LfnOfs[s]);		/* Pick an LFN character */
 		if (wc != 0) {
-			if (i >= FF_MAX_LFN || ff_wtoupper(uc) != ff_wtoupper(lfnbuf[i++])) {	/* Compare it */
+			if (i >= FF_MAX_LFN || up_wchar(uc) != up_wchar(lfnbuf[i++])) {	/* Compare it */
 				return 0;					/* Not matched */
 			}
 			wc = uc;
@@ -2110,13 +2895,14 @@ static DWORD xsum32 (	/* Returns 32-bit checksum */
 
 
 #if FF_FS_MINIMIZE <= 1 || FF_FS_RPATH >= 2
-/*------------------------------------------------------*/
-/* exFAT: Get object information from a directory block */
-/*------------------------------------------------------*/
+/*-----------------------------------------------*/
+/* exFAT: Get object name from a directory block */
+/*-----------------------------------------------*/
 
-static void get_xfileinfo (
+static UINT get_xfname (	/* Returns number of TCHARs stored including the terminator (0:it may not fit in fn[]) */
 	BYTE* dirb,			/* Pointer to the direcotry entry block 85+C0+C1s */
-	FILINFO* fno		/* Buffer to store the extracted file information */
+	TCHAR* fn,			/* Buffer to store the file name */
+	UINT szfn			/* Size of the buffer (FF_LFN_BUF + 1 at most) */
 )
 {
 	WCHAR wc, hs;
@@ -2132,20 +2918,18 @@ static void get_xfileinfo (
 		if (hs == 0 && IsSurrogate(wc)) {	/* Is it a surrogate? */
 			hs = wc; continue;	/* Get low surrogate */
 		}
-		wc = put_utf((DWORD)hs << 16 | wc, &fno->fname[di], FF_LFN_BUF - di);	/* Store it in API encoding */
+		wc = put_utf((DWORD)hs << 16 | wc, &fn[di], szfn - 1 - di);	/* Store it in API encoding */
 		if (wc == 0) { di = 0; break; }	/* Buffer overflow or wrong encoding? */
 		di += wc;
 		hs = 0;
 	}
 	if (hs != 0) di = 0;					/* Broken surrogate pair? */
-	if (di == 0) fno->fname[di++] = '?';	/* Inaccessible object name? */
-	fno->fname[di] = 0;						/* Terminate the name */
-	fno->altname[0] = 0;					/* exFAT does not support SFN */
-
-	fno->fattrib = dirb[XDIR_Attr];			/* Attribute */
-	fno->fsize = (fno->fattrib & AM_DIR) ? 0 : ld_qword(dirb + XDIR_FileSize);	/* Size */
-	fno->ftime = ld_word(dirb + XDIR_ModTime + 0);	/* Time */
-	fno->fdate = ld_word(dirb + XDIR_ModTime + 2);	/* Date */
+	if (di == 0) {							/* Inaccessible object name? */
+		if (szfn <= FF_LFN_BUF) return 0;	/* (It may have failed for lack of room) */
+		fn[di++] = '?';
+	}
+	fn[di] = 0;								/* Terminate the name */
+	return di + 1;
 }
 
 #endif	/* FF_FS_MINIMIZE <= 1 || FF_FS_RPATH >= 2 */
@@ -2176,6 +2960,9 @@ static FRESULT load_xdir (	/* FR_INT_ERR: invalid entry block */
 	res = dir_next(dp, 0);
 	if (res == FR_NO_FILE) res = FR_INT_ERR;	/* It cannot be */
 	if (res != FR_OK) return res;
+#if DIR_RA
+	dir_readahead(dp);
+#endif
 	res = move_window(dp->obj.fs, dp->sect);
 	if (res != FR_OK) return res;
 	if (dp->dir[XDIR_Type] != ET_STREAM) return FR_INT_ERR;	/* Invalid order */
@@ -2188,6 +2975,9 @@ static FRESULT load_xdir (	/* FR_INT_ERR: invalid entry block */
 		res = dir_next(dp, 0);
 		if (res == FR_NO_FILE) res = FR_INT_ERR;	/* It cannot be */
 		if (res != FR_OK) return res;
+#if DIR_RA
+		dir_readahead(dp);
+#endif
 		res = move_window(dp->obj.fs, dp->sect);
 		if (res != FR_OK) return res;
 		if (dp->dir[XDIR_Type] != ET_FILENAME) return FR_INT_ERR;	/* Invalid order */
@@ -2344,6 +3134,9 @@ static FRESULT dir_read (
 #endif
 
 	while (dp->sect) {
+#if DIR_RA
+		dir_readahead(dp);
+#endif
 		res = move_window(fs, dp->sect);
 		if (res != FR_OK) break;
 		b = dp->dir[DIR_Name];	/* Test for the entry type */
@@ -2405,67 +3198,357 @@ static FRESULT dir_read (
 
 
 
+#if FF_DIR_INDEX
 /*-----------------------------------------------------------------------*/
-/* Directory handling - Find an object in the directory                  */
+/* Directory index - Hash of names to entry blocks in a large directory  */
 /*-----------------------------------------------------------------------*/
 
-static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
-	DIR* dp					/* Pointer to the directory object with the file name */
+#define DIX_MIN_ENT	64		/* Number of entries a linear search has to pass through to get the directory indexed */
+#define DIX_TOMB	1		/* Index slot of a removed entry (hash 0 is never used) */
+
+#if FF_DIR_INDEX & (FF_DIR_INDEX - 1)
+#error FF_DIR_INDEX must be a power of 2
+#endif
+
+static WORD dix_fold (	/* Index hash value (never 0) */
+	DWORD h				/* Hash accumulator */
+)
+{
+	h ^= h >> 16;
+	return (WORD)h ? (WORD)h : 1;
+}
+
+
+static DWORD dix_sfn (	/* Hash accumulator of an SFN */
+	const BYTE* sfn		/* Pointer to the SFN (11 bytes) */
+)
+{
+	DWORD h = 0;
+	UINT i;
+
+	for (i = 0; i < 11; i++) h = h * 31 + sfn[i];
+	return h * 0x9E3779B1;
+}
+
+
+#if FF_USE_LFN
+static DWORD dix_lfn (	/* Hash of a character of an LFN (LFN hash is the sum of them, thus LFN entries can be added in any order) */
+	WCHAR wc,			/* Character */
+	UINT i				/* Position of the character in the LFN */
+)
+{
+	DWORD h = ff_wtoupper(wc) | (DWORD)i << 16;
+
+	h ^= h >> 16; h *= 0x85EBCA6B;	/* Mix the character and its position */
+	h ^= h >> 13; h *= 0xC2B2AE35;
+	return h ^ (h >> 16);
+}
+#endif
+
+
+static int dix_put (	/* 1:Added, 0:Index is full */
+	FATFS* fs,			/* Filesystem object */
+	WORD hash,			/* Name hash */
+	DWORD ofs			/* Offset of the entry block in the directory */
+)
+{
+	UINT i;
+	DWORD e;
+
+
+	for (i = hash & (FF_DIR_INDEX - 1); (e = fs->dix[i]) != 0 && e != DIX_TOMB; i = (i + 1) & (FF_DIR_INDEX - 1)) ;
+	if (e == 0) {	/* Taking an empty slot? (keep some empty slots to terminate the search) */
+		if (fs->dix_cnt >= FF_DIR_INDEX / 4 * 3) return 0;
+		fs->dix_cnt++;
+	}
+	fs->dix[i] = (DWORD)hash << 16 | ofs / SZDIRE;
+	return 1;
+}
+
+
+static FRESULT dix_build (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp					/* Directory to index */
 )
 {
 	FRESULT res;
 	FATFS *fs = dp->obj.fs;
+	DIR dj;
 	BYTE c;
+	DWORD blk;
 #if FF_USE_LFN
 	BYTE a, ord, sum;
+	DWORD h = 0;
+	UINT i, s;
+	WCHAR wc;
 #endif
 
-	res = dir_sdi(dp, 0);			/* Rewind directory object */
-	if (res != FR_OK) return res;
-#if FF_FS_EXFAT
-	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
-		BYTE nc;
-		UINT di, ni;
-		WORD hash = xname_sum(fs->lfnbuf);		/* Hash value of the name to find */
 
-		while ((res = DIR_READ_FILE(dp)) == FR_OK) {	/* Read an item */
-#if FF_MAX_LFN < 255
-			if (fs->dirbuf[XDIR_NumName] > FF_MAX_LFN) continue;			/* Skip comparison if inaccessible object name */
-#endif
-			if (ld_word(fs->dirbuf + XDIR_NameHash) != hash) continue;	/* Skip comparison if hash mismatched */
-			for (nc = fs->dirbuf[XDIR_NumName], di = SZDIRE * 2, ni = 0; nc; nc--, di += 2, ni++) {	/* Compare the name */
-				if ((di % SZDIRE) == 0) di += 2;
-				if (ff_wtoupper(ld_word(fs->dirbuf + di)) != ff_wtoupper(fs->lfnbuf[ni])) break;
-			}
-			if (nc == 0 && !fs->lfnbuf[ni]) break;	/* Name matched? */
-		}
-		return res;
-	}
-#endif
-	/* On the FAT/FAT32 volume */
+	mem_set(fs->dix, 0, sizeof fs->dix);	/* Clear the index */
+	fs->dix_cnt = 0;
+	fs->dix_clst = dp->obj.sclust;
+	fs->dix_stat = 2;				/* Too many names to index unless all of them are added */
+	mem_cpy(&dj, dp, sizeof (DIR));	/* Keep the directory object of the caller */
+	res = dir_sdi(&dj, 0);
 #if FF_USE_LFN
-	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
+	ord = sum = 0xFF;
 #endif
-	do {
-		res = move_window(fs, dp->sect);
+	blk = 0xFFFFFFFF;
+	while (res == FR_OK) {
+		res = move_window(fs, dj.sect);
 		if (res != FR_OK) break;
-		c = dp->dir[DIR_Name];
+		c = dj.dir[DIR_Name];
 		if (c == 0) { res = FR_NO_FILE; break; }	/* Reached to end of table */
-#if FF_USE_LFN		/* LFN configuration */
-		dp->obj.attr = a = dp->dir[DIR_Attr] & AM_MASK;
+#if FF_USE_LFN		/* Track LFN sequences the same way dir_find() does */
+		a = dj.dir[DIR_Attr] & AM_MASK;
 		if (c == DDEM || ((a & AM_VOL) && a != AM_LFN)) {	/* An entry without valid data */
-			ord = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
-		} else {
-			if (a == AM_LFN) {			/* An LFN entry is found */
-				if (!(dp->fn[NSFLAG] & NS_NOLFN)) {
-					if (c & LLEF) {		/* Is it start of LFN sequence? */
-						sum = dp->dir[LDIR_Chksum];
-						c &= (BYTE)~LLEF; ord = c;	/* LFN start order */
-						dp->blk_ofs = dp->dptr;	/* Start offset of LFN */
-					}
-					/* Check validity of the LFN entry and compare it with given name */
-					ord = (c == ord && sum == dp->dir[LDIR_Chksum] && cmp_lfn(fs->lfnbuf, dp->dir)) ? ord - 1 : 0xFF;
-				}
+			ord = 0xFF; blk = 0xFFFFFFFF;
+		} else if (a == AM_LFN) {		/* An LFN entry */
+			if (c & LLEF) {				/* Start of LFN sequence */
+				sum = dj.dir[LDIR_Chksum];
+				c &= (BYTE)~LLEF; ord = c;
+				blk = dj.dptr; h = 0;
+			}
+			if (c == ord && sum == dj.dir[LDIR_Chksum]) {
+				for (i = (c - 1) * 13, s = 0; s < 13 && (wc = ld_word(dj.dir + LfnOfs[s])) != 0; s++, i++) h += dix_lfn(wc, i);
+				ord--;
+			} else {
+				ord = 0xFF;
+			}
+		} else {						/* An SFN entry */
+			if (blk == 0xFFFFFFFF) blk = dj.dptr;
+			if (ord == 0 && sum == sum_sfn(dj.dir) && !dix_put(fs, dix_fold(h), blk)) break;	/* Name can be found by the LFN */
+			if (!dix_put(fs, dix_fold(dix_sfn(dj.dir)), blk)) break;	/* Name can be found by the SFN */
+			ord = 0xFF; blk = 0xFFFFFFFF;
+		}
+#else
+		if (!(dj.dir[DIR_Attr] & AM_VOL) && c != DDEM) {
+			blk = dj.dptr;
+			if (!dix_put(fs, dix_fold(dix_sfn(dj.dir)), blk)) break;
+		}
+#endif
+		res = dir_next(&dj, 0);	/* Next entry */
+	}
+	if (res == FR_NO_FILE) {	/* All names are in the index? */
+		fs->dix_stat = 1;
+		res = FR_OK;
+	} else if (res != FR_OK) {
+		fs->dix_stat = 0;
+	}
+	return res;
+}
+
+
+static FRESULT dix_match (	/* FR_OK(0):matched, FR_NO_FILE:not matched, !=0:error */
+	DIR* dp,				/* Pointer to the directory object with the file name */
+	DWORD ofs				/* Offset of the entry block to check */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	BYTE c;
+#if FF_USE_LFN
+	BYTE a, ord, sum;
+#endif
+
+	res = dir_sdi(dp, ofs);
+#if FF_USE_LFN
+	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
+#endif
+	while (res == FR_OK) {
+		res = move_window(fs, dp->sect);
+		if (res != FR_OK) break;
+		c = dp->dir[DIR_Name];
+		if (c == 0) return FR_NO_FILE;	/* Stale index slot */
+#if FF_USE_LFN
+		dp->obj.attr = a = dp->dir[DIR_Attr] & AM_MASK;
+		if (c == DDEM || ((a & AM_VOL) && a != AM_LFN)) return FR_NO_FILE;	/* Stale index slot */
+		if (a != AM_LFN) {	/* An SFN entry ends the block */
+			if (ord == 0 && sum == sum_sfn(dp->dir)) return FR_OK;	/* LFN matched? */
+			if (!(dp->fn[NSFLAG] & NS_LOSS) && !mem_cmp(dp->dir, dp->fn, 11)) return FR_OK;	/* SFN matched? */
+			return FR_NO_FILE;
+		}
+		if (!(dp->fn[NSFLAG] & NS_NOLFN)) {	/* Check the LFN entry as dir_find() does */
+			if (c & LLEF) {
+				sum = dp->dir[LDIR_Chksum];
+				c &= (BYTE)~LLEF; ord = c;
+				dp->blk_ofs = dp->dptr;
+			}
+			ord = (c == ord && sum == dp->dir[LDIR_Chksum] && cmp_lfn(fs->lfnbuf, dp->dir)) ? ord - 1 : 0xFF;
+		}
+#else
+		dp->obj.attr = dp->dir[DIR_Attr] & AM_MASK;
+		return (!(dp->dir[DIR_Attr] & AM_VOL) && !mem_cmp(dp->dir, dp->fn, 11)) ? FR_OK : FR_NO_FILE;
+#endif
+		res = dir_next(dp, 0);	/* Next entry */
+	}
+	return res;
+}
+
+
+static FRESULT dix_find (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp					/* Pointer to the directory object with the file name */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	WORD hash[2];
+	UINT n = 0, k, i;
+	DWORD e;
+#if FF_USE_LFN
+	DWORD h = 0;
+#endif
+
+
+#if FF_USE_LFN
+	if (!(dp->fn[NSFLAG] & NS_NOLFN)) {	/* The name can match an LFN */
+		for (i = 0; fs->lfnbuf[i]; i++) h += dix_lfn(fs->lfnbuf[i], i);
+		hash[n++] = dix_fold(h);
+	}
+	if (!(dp->fn[NSFLAG] & NS_LOSS))	/* The name can match an SFN */
+#endif
+	hash[n++] = dix_fold(dix_sfn(dp->fn));
+
+	for (k = 0; k < n; k++) {	/* Check the entry blocks with the same name hash */
+		for (i = hash[k] & (FF_DIR_INDEX - 1); (e = fs->dix[i]) != 0; i = (i + 1) & (FF_DIR_INDEX - 1)) {
+			if ((WORD)(e >> 16) != hash[k]) continue;
+			res = dix_match(dp, (e & 0xFFFF) * SZDIRE);
+			if (res != FR_NO_FILE) return res;
+		}
+	}
+	return FR_NO_FILE;
+}
+
+
+#if !FF_FS_READONLY
+static void dix_add (
+	DIR* dp,			/* Directory object pointing the registered SFN entry */
+	UINT nlfn			/* Number of LFN entries preceding the SFN entry */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	DWORD blk = dp->dptr - nlfn * SZDIRE;
+	int ok = 1;
+#if FF_USE_LFN
+	DWORD h = 0;
+	UINT i;
+#endif
+
+
+	if (fs->dix_stat != 1 || fs->dix_clst != dp->obj.sclust) return;	/* Directory is not indexed */
+#if FF_USE_LFN
+	if (nlfn) {
+		for (i = 0; fs->lfnbuf[i]; i++) h += dix_lfn(fs->lfnbuf[i], i);
+		ok = dix_put(fs, dix_fold(h), blk);
+	}
+#endif
+	if (ok) ok = dix_put(fs, dix_fold(dix_sfn(dp->fn)), blk);
+	if (!ok) fs->dix_stat = 0;	/* Index is full and needs to be rebuilt */
+}
+
+
+static void dix_remove (
+	DIR* dp				/* Directory object pointing the entry to be removed */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	DWORD idx;
+	UINT i;
+
+
+	if (fs->dix_stat != 1 || fs->dix_clst != dp->obj.sclust) return;	/* Directory is not indexed */
+#if FF_USE_LFN
+	idx = (dp->blk_ofs == 0xFFFFFFFF ? dp->dptr : dp->blk_ofs) / SZDIRE;
+#else
+	idx = dp->dptr / SZDIRE;
+#endif
+	for (i = 0; i < FF_DIR_INDEX; i++) {	/* Remove all names of the entry block */
+		if (fs->dix[i] != 0 && (fs->dix[i] & 0xFFFF) == idx) fs->dix[i] = DIX_TOMB;
+	}
+}
+#endif
+
+#endif	/* FF_DIR_INDEX */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Find an object in the directory                  */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp					/* Pointer to the directory object with the file name */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	BYTE c;
+#if FF_USE_LFN
+	BYTE a, ord, sum;
+#endif
+#if FF_DIR_INDEX
+	UINT n = 0;
+#endif
+
+	res = dir_sdi(dp, 0);			/* Rewind directory object */
+	if (res != FR_OK) return res;
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
+		BYTE nc;
+		UINT di, ni;
+		DWORD d, n;
+		WORD hash = xname_sum(fs->lfnbuf);		/* Hash value of the name to find */
+
+		while ((res = DIR_READ_FILE(dp)) == FR_OK) {	/* Read an item */
+#if FF_MAX_LFN < 255
+			if (fs->dirbuf[XDIR_NumName] > FF_MAX_LFN) continue;			/* Skip comparison if inaccessible object name */
+#endif
+			if (ld_word(fs->dirbuf + XDIR_NameHash) != hash) continue;	/* Skip comparison if hash mismatched */
+			for (nc = fs->dirbuf[XDIR_NumName], di = SZDIRE * 2, ni = 0; nc; nc--, di += 2, ni++) {	/* Compare the name */
+				if ((di % SZDIRE) == 0) di += 2;
+				if (nc >= 2 && (di % SZDIRE) != SZDIRE - 2) {	/* Two characters in the same entry? */
+					d = ld_dword(fs->dirbuf + di);
+					n = fs->lfnbuf[ni] | (DWORD)fs->lfnbuf[ni + 1] << 16;
+					if (IsAscii2(d | n)) {	/* Compare two ASCII characters at a time */
+						if (UpAscii2(d) != UpAscii2(n)) break;
+						nc--; di += 2; ni++;
+						continue;
+					}
+				}
+				if (up_wchar(ld_word(fs->dirbuf + di)) != up_wchar(fs->lfnbuf[ni])) break;
+			}
+			if (nc == 0 && !fs->lfnbuf[ni]) break;	/* Name matched? */
+		}
+		return res;
+	}
+#endif
+	/* On the FAT/FAT32 volume */
+#if FF_DIR_INDEX
+	if (fs->dix_clst == dp->obj.sclust && fs->dix_stat == 1) return dix_find(dp);	/* Use the index if the directory is indexed */
+#endif
+#if FF_USE_LFN
+	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
+#endif
+	do {
+		res = move_window(fs, dp->sect);
+		if (res != FR_OK) break;
+		c = dp->dir[DIR_Name];
+		if (c == 0) { res = FR_NO_FILE; break; }	/* Reached to end of table */
+#if FF_USE_LFN		/* LFN configuration */
+		dp->obj.attr = a = dp->dir[DIR_Attr] & AM_MASK;
+		if (c == DDEM || ((a & AM_VOL) && a != AM_LFN)) {	/* An entry without valid data */
+			ord = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
+		} else {
+			if (a == AM_LFN) {			/* An LFN entry is found */
+				if (!(dp->fn[NSFLAG] & NS_NOLFN)) {
+					if (c & LLEF) {		/* Is it start of LFN sequence? */
+						sum = dp->dir[LDIR_Chksum];
+						c &= (BYTE)~LLEF; ord = c;	/* LFN start order */
+						dp->blk_ofs = dp->dptr;	/* Start offset of LFN */
+					}
+					/* Check validity of the LFN entry and compare it with given name */
+					ord = (c == ord && sum == dp->dir[LDIR_Chksum] && cmp_lfn(fs->lfnbuf, dp->dir)) ? ord - 1 : 0xFF;
+				}
 			} else {					/* An SFN entry is found */
 				if (ord == 0 && sum == sum_sfn(dp->dir)) break;	/* LFN matched? */
 				if (!(dp->fn[NSFLAG] & NS_LOSS) && !mem_cmp(dp->dir, dp->fn, 11)) break;	/* SFN matched? */
@@ -2475,10 +3558,21 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 #else		/* Non LFN configuration */
 		dp->obj.attr = dp->dir[DIR_Attr] & AM_MASK;
 		if (!(dp->dir[DIR_Attr] & AM_VOL) && !mem_cmp(dp->dir, dp->fn, 11)) break;	/* Is it a valid entry? */
+#endif
+#if FF_DIR_INDEX
+		n++;
 #endif
 		res = dir_next(dp, 0);	/* Next entry */
 	} while (res == FR_OK);
 
+#if FF_DIR_INDEX
+	if ((res == FR_OK || res == FR_NO_FILE) && n >= DIX_MIN_ENT	/* Has a large directory been searched? */
+		&& (fs->dix_clst != dp->obj.sclust || fs->dix_stat != 2)) {	/* (and it was not found too large to be indexed) */
+		FRESULT r = dix_build(dp);		/* Index it for the next search */
+		if (r == FR_OK && res == FR_OK) r = move_window(fs, dp->sect);	/* Restore the window with the found entry */
+		if (r != FR_OK) res = r;
+	}
+#endif
 	return res;
 }
 
@@ -2581,6 +3675,13 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 			dp->dir[DIR_NTres] = dp->fn[NSFLAG] & (NS_BODY | NS_EXT);	/* Put NT flag */
 #endif
 			fs->wflag = 1;
+#if FF_DIR_INDEX
+#if FF_USE_LFN
+			dix_add(dp, (sn[NSFLAG] & NS_LFN) ? (nlen + 12) / 13 : 0);	/* Add the name to the directory index */
+#else
+			dix_add(dp, 0);
+#endif
+#endif
 		}
 	}
 
@@ -2605,6 +3706,12 @@ static FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 #if FF_USE_LFN		/* LFN configuration */
 	DWORD last = dp->dptr;
 
+#if FF_USE_CHKVOL
+	fs->chk_gen++;		/* The directory has been changed */
+#endif
+#if FF_DIR_INDEX
+	dix_remove(dp);		/* Remove the names from the directory index */
+#endif
 	res = (dp->blk_ofs == 0xFFFFFFFF) ? FR_OK : dir_sdi(dp, dp->blk_ofs);	/* Goto top of the entry block if LFN is exist */
 	if (res == FR_OK) {
 		do {
@@ -2623,6 +3730,12 @@ static FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 	}
 #else			/* Non LFN configuration */
 
+#if FF_USE_CHKVOL
+	fs->chk_gen++;		/* The directory has been changed */
+#endif
+#if FF_DIR_INDEX
+	dix_remove(dp);		/* Remove the name from the directory index */
+#endif
 	res = move_window(fs, dp->sect);
 	if (res == FR_OK) {
 		dp->dir[DIR_Name] = DDEM;	/* Mark the entry 'deleted'.*/
@@ -2642,13 +3755,16 @@ static FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 /* Get file information from directory entry                             */
 /*-----------------------------------------------------------------------*/
 
-static void get_fileinfo (
+static UINT get_fname (	/* Returns number of TCHARs stored in fn[] including the terminator (0:it may not fit in fn[]) */
 	DIR* dp,			/* Pointer to the directory object */
-	FILINFO* fno		/* Pointer to the file information to be filled */
+	TCHAR* fn,			/* Buffer to store the primary file name */
+	UINT szfn,			/* Size of the buffer (FF_SFN_BUF + 1 at least, FF_LFN_BUF + 1 at most) */
+	TCHAR* altname		/* Buffer to store the alternative file name [FF_SFN_BUF + 1] (not used at non-LFN cfg) */
 )
 {
 	UINT si, di;
 #if FF_USE_LFN
+	UINT ni = 0;
 	WCHAR wc, hs;
 	FATFS *fs = dp->obj.fs;
 #else
@@ -2656,32 +3772,30 @@ static void get_fileinfo (
 #endif
 
 
-	fno->fname[0] = 0;			/* Invaidate file info */
-	if (dp->sect == 0) return;	/* Exit if read pointer has reached end of directory */
-
 #if FF_USE_LFN		/* LFN configuration */
 #if FF_FS_EXFAT
 	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
-		get_xfileinfo(fs->dirbuf, fno);
-		return;
+		altname[0] = 0;				/* exFAT does not support SFN */
+		return get_xfname(fs->dirbuf, fn, szfn);
 	} else
 #endif
 	{	/* On the FAT/FAT32 volume */
 		if (dp->blk_ofs != 0xFFFFFFFF) {	/* Get LFN if available */
-			si = di = hs = 0;
+			si = hs = 0;
 			while (fs->lfnbuf[si] != 0) {
 				wc = fs->lfnbuf[si++];		/* Get an LFN character (UTF-16) */
 				if (hs == 0 && IsSurrogate(wc)) {	/* Is it a surrogate? */
 					hs = wc; continue;		/* Get low surrogate */
 				}
-				wc = put_utf((DWORD)hs << 16 | wc, &fno->fname[di], FF_LFN_BUF - di);	/* Store it in UTF-16 or UTF-8 encoding */
-				if (wc == 0) { di = 0; break; }	/* Invalid char or buffer overflow? */
-				di += wc;
+				wc = put_utf((DWORD)hs << 16 | wc, &fn[ni], szfn - 1 - ni);	/* Store it in UTF-16 or UTF-8 encoding */
+				if (wc == 0) { ni = 0; break; }	/* Invalid char or buffer overflow? */
+				ni += wc;
 				hs = 0;
 			}
-			if (hs != 0) di = 0;	/* Broken surrogate pair? */
-			fno->fname[di] = 0;		/* Terminate the LFN (null string means LFN is invalid) */
+			if (hs != 0) ni = 0;	/* Broken surrogate pair? */
+			if (ni == 0 && szfn <= FF_LFN_BUF) return 0;	/* (It may have failed for lack of room) */
 		}
+		fn[ni] = 0;		/* Terminate the LFN (null string means LFN is invalid) */
 	}
 
 	si = di = 0;
@@ -2689,48 +3803,80 @@ static void get_fileinfo (
 		wc = dp->dir[si++];			/* Get a char */
 		if (wc == ' ') continue;	/* Skip padding spaces */
 		if (wc == RDDEM) wc = DDEM;	/* Restore replaced DDEM character */
-		if (si == 9 && di < FF_SFN_BUF) fno->altname[di++] = '.';	/* Insert a . if extension is exist */
+		if (si == 9 && di < FF_SFN_BUF) altname[di++] = '.';	/* Insert a . if extension is exist */
 #if FF_LFN_UNICODE >= 1	/* Unicode output */
 		if (dbc_1st((BYTE)wc) && si != 8 && si != 11 && dbc_2nd(dp->dir[si])) {	/* Make a DBC if needed */
 			wc = wc << 8 | dp->dir[si++];
 		}
 		wc = ff_oem2uni(wc, CODEPAGE);		/* ANSI/OEM -> Unicode */
 		if (wc == 0) { di = 0; break; }		/* Wrong char in the current code page? */
-		wc = put_utf(wc, &fno->altname[di], FF_SFN_BUF - di);	/* Store it in Unicode */
+		wc = put_utf(wc, &altname[di], FF_SFN_BUF - di);	/* Store it in Unicode */
 		if (wc == 0) { di = 0; break; }		/* Buffer overflow? */
 		di += wc;
 #else					/* ANSI/OEM output */
-		fno->altname[di++] = (TCHAR)wc;	/* Store it without any conversion */
+		altname[di++] = (TCHAR)wc;	/* Store it without any conversion */
 #endif
 	}
-	fno->altname[di] = 0;	/* Terminate the SFN  (null string means SFN is invalid) */
+	altname[di] = 0;	/* Terminate the SFN  (null string means SFN is invalid) */
 
-	if (fno->fname[0] == 0) {	/* If LFN is invalid, altname[] needs to be copied to fname[] */
+	if (ni == 0) {	/* If LFN is invalid, altname[] needs to be copied to fname[] */
 		if (di == 0) {	/* If LFN and SFN both are invalid, this object is inaccesible */
-			fno->fname[di++] = '?';
+			fn[ni++] = '?';
 		} else {
-			for (si = di = 0; fno->altname[si]; si++, di++) {	/* Copy altname[] to fname[] with case information */
-				wc = (WCHAR)fno->altname[si];
+			for (si = 0; altname[si]; si++, ni++) {	/* Copy altname[] to fname[] with case information */
+				wc = (WCHAR)altname[si];
 				if (IsUpper(wc) && (dp->dir[DIR_NTres] & ((si >= 9) ? NS_EXT : NS_BODY))) wc += 0x20;
-				fno->fname[di] = (TCHAR)wc;
+				fn[ni] = (TCHAR)wc;
 			}
 		}
-		fno->fname[di] = 0;	/* Terminate the LFN */
-		if (!dp->dir[DIR_NTres]) fno->altname[0] = 0;	/* Altname is not needed if neither LFN nor case info is exist. */
+		fn[ni] = 0;	/* Terminate the LFN */
+		if (!dp->dir[DIR_NTres]) altname[0] = 0;	/* Altname is not needed if neither LFN nor case info is exist. */
 	}
+	return ni + 1;
 
 #else	/* Non-LFN configuration */
+	(void)szfn; (void)altname;
 	si = di = 0;
 	while (si < 11) {		/* Copy name body and extension */
 		c = (TCHAR)dp->dir[si++];
 		if (c == ' ') continue;		/* Skip padding spaces */
 		if (c == RDDEM) c = DDEM;	/* Restore replaced DDEM character */
-		if (si == 9) fno->fname[di++] = '.';/* Insert a . if extension is exist */
-		fno->fname[di++] = c;
+		if (si == 9) fn[di++] = '.';/* Insert a . if extension is exist */
+		fn[di++] = c;
 	}
-	fno->fname[di] = 0;
+	fn[di] = 0;
+	return di + 1;
+#endif
+}
+
+
+static void get_fileinfo (
+	DIR* dp,			/* Pointer to the directory object */
+	FILINFO* fno		/* Pointer to the file information to be filled */
+)
+{
+#if FF_FS_EXFAT
+	FATFS *fs = dp->obj.fs;
 #endif
 
+
+	fno->fname[0] = 0;			/* Invaidate file info */
+	if (dp->sect == 0) return;	/* Exit if read pointer has reached end of directory */
+
+#if FF_USE_LFN
+	get_fname(dp, fno->fname, FF_LFN_BUF + 1, fno->altname);
+#else
+	get_fname(dp, fno->fname, 12 + 1, 0);
+#endif
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
+		fno->fattrib = fs->dirbuf[XDIR_Attr];		/* Attribute */
+		fno->fsize = (fno->fattrib & AM_DIR) ? 0 : ld_qword(fs->dirbuf + XDIR_FileSize);	/* Size */
+		fno->ftime = ld_word(fs->dirbuf + XDIR_ModTime + 0);	/* Time */
+		fno->fdate = ld_word(fs->dirbuf + XDIR_ModTime + 2);	/* Date */
+		return;
+	}
+#endif
 	fno->fattrib = dp->dir[DIR_Attr];					/* Attribute */
 	fno->fsize = ld_dword(dp->dir + DIR_FileSize);		/* Size */
 	fno->ftime = ld_word(dp->dir + DIR_ModTime + 0);	/* Time */
@@ -2766,7 +3912,7 @@ static DWORD get_achar (	/* Get a character and advances ptr */
 #elif FF_CODE_PAGE < 900
 	if (chr >= 0x80) chr = ExCvt[chr - 0x80];	/* To upper SBCS extended char */
 #endif
-#if FF_CODE_PAGE == 0 || FF_CODE_PAGE >= 900
+#if FF_CODE_PAGE == 0 || (FF_CODE_PAGE >= 900 && FF_CODE_PAGE != 20127)
 	if (dbc_1st((BYTE)chr)) {	/* Get DBC 2nd byte if needed */
 		chr = dbc_2nd((BYTE)**ptr) ? chr << 8 | (BYTE)*(*ptr)++ : 0;
 	}
@@ -2816,72 +3962,247 @@ static int pattern_matching (	/* 0:not matched, 1:matched */
 	return 0;
 }
 
-#endif /* FF_USE_FIND && FF_FS_MINIMIZE <= 1 */
-
 
 
 /*-----------------------------------------------------------------------*/
-/* Pick a top segment and create the object name in directory form       */
+/* Compiled pattern matching                                             */
 /*-----------------------------------------------------------------------*/
+/* f_findfirst converts the pattern into up-case characters once, so that
+/  the name of each directory item is matched without parsing the pattern
+/  again. '?' and '*' stand for themselves as they cannot be in a name. */
 
-static FRESULT create_name (	/* FR_OK: successful, FR_INVALID_NAME: could not create */
-	DIR* dp,					/* Pointer to the directory object */
-	const TCHAR** path			/* Pointer to pointer to the segment in the path string */
+#if FF_FIND_PAT < 1 || FF_FIND_PAT > 254
+#error Wrong FF_FIND_PAT setting
+#endif
+
+static void compile_pattern (
+	DIR* dp				/* Directory object with the pattern to compile */
 )
 {
-#if FF_USE_LFN		/* LFN configuration */
-	BYTE b, cf;
-	WCHAR wc, *lfn;
-	DWORD uc;
-	UINT i, ni, si, di;
-	const TCHAR *p;
+	const TCHAR *pp = dp->pat;
+	DWORD pc;
+	UINT n = 0;
 
 
-	/* Create LFN into LFN working buffer */
-	p = *path; lfn = dp->obj.fs->lfnbuf; di = 0;
+	dp->pfx_len = 0xFF;
 	for (;;) {
-		uc = tchar2uni(&p);			/* Get a character */
-		if (uc == 0xFFFFFFFF) return FR_INVALID_NAME;		/* Invalid code or UTF decode error */
-		if (uc >= 0x10000) lfn[di++] = (WCHAR)(uc >> 16);	/* Store high surrogate if needed */
-		wc = (WCHAR)uc;
-		if (wc < ' ' || wc == '/' || wc == '\\') break;	/* Break if end of the path or a separator is found */
-		if (wc < 0x80 && chk_chr("\"*:<>\?|\x7F", wc)) return FR_INVALID_NAME;	/* Reject illegal characters for LFN */
-		if (di >= FF_MAX_LFN) return FR_INVALID_NAME;	/* Reject too long name */
-		lfn[di++] = wc;					/* Store the Unicode character */
-	}
-	while (*p == '/' || *p == '\\') p++;	/* Skip duplicated separators if exist */
-	*path = p;							/* Return pointer to the next segment */
-	cf = (wc < ' ') ? NS_LAST : 0;		/* Set last segment flag if end of the path */
-
-#if FF_FS_RPATH != 0
-	if ((di == 1 && lfn[di - 1] == '.') ||
-		(di == 2 && lfn[di - 1] == '.' && lfn[di - 2] == '.')) {	/* Is this segment a dot name? */
-		lfn[di] = 0;
-		for (i = 0; i < 11; i++) {		/* Create dot name for SFN entry */
-			dp->fn[i] = (i < di) ? '.' : ' ';
+		pc = get_achar(&pp);		/* Get an up-case pattern char */
+		if (pc == 0) break;
+		if (pc == '*' && n > 0 && dp->cpat[n - 1] == '*') continue;	/* Merge the stars */
+		if (pc >= 0x10000 || n >= FF_FIND_PAT) {	/* Cannot be compiled? */
+			dp->pat_len = 0xFF; return;
 		}
-		dp->fn[i] = cf | NS_DOT;		/* This is a dot entry */
-		return FR_OK;
-	}
-#endif
-	while (di) {						/* Snip off trailing spaces and dots if exist */
-		wc = lfn[di - 1];
-		if (wc != ' ' && wc != '.') break;
-		di--;
+		if ((pc == '*' || pc == '?') && dp->pfx_len == 0xFF) dp->pfx_len = (BYTE)n;	/* End of literal prefix */
+		dp->cpat[n++] = (WCHAR)pc;
 	}
-	lfn[di] = 0;							/* LFN is created into the working buffer */
-	if (di == 0) return FR_INVALID_NAME;	/* Reject null name */
+	dp->pat_len = (BYTE)n;
+	if (dp->pfx_len == 0xFF) dp->pfx_len = (BYTE)n;
+}
+
+
+static int match_pattern (	/* 0:not matched, 1:matched */
+	const DIR* dp,		/* Directory object with the compiled pattern */
+	const TCHAR* nam	/* String to be tested */
+)
+{
+	const WCHAR *cp = dp->cpat, *ce = dp->cpat + dp->pat_len, *sp = 0;
+	const TCHAR *np, *sn = 0;
+	DWORD nc;
 
-	/* Create SFN in directory form */
-	for (si = 0; lfn[si] == ' '; si++) ;	/* Remove leading spaces */
-	if (si > 0 || lfn[si] == '.') cf |= NS_LOSS | NS_LFN;	/* Is there any leading space or dot? */
-	while (di > 0 && lfn[di - 1] != '.') di--;	/* Find last dot (di<=si: no extension) */
 
-	mem_set(dp->fn, ' ', 11);
-	i = b = 0; ni = 8;
 	for (;;) {
-		wc = lfn[si++];					/* Get an LFN character */
-		if (wc == 0) break;				/* Break on end of the LFN */
+		np = nam;
+		nc = get_achar(&nam);		/* Get an up-case name char */
+		if (cp < ce && *cp == '*') {	/* Star: try to match the rest from here, then from the next chars */
+			sp = ++cp; sn = nam = np;
+			continue;
+		}
+		if (cp < ce && nc != 0 && (*cp == '?' || *cp == nc)) {	/* Char matched? */
+			cp++;
+			continue;
+		}
+		if (cp == ce && nc == 0) return 1;	/* Matched at end of both strings */
+		if (!sp) return 0;			/* No star to retry with */
+		nam = sn;
+		if (!get_achar(&nam)) return 0;	/* Let the last star take one more name char */
+		sn = nam; cp = sp;
+	}
+}
+
+
+/* The literal prefix of the pattern is checked against the name in the
+/  directory entry before the name is decoded. Only ASCII characters are
+/  compared, the check is inconclusive (0) at any other one. */
+
+static int sfn_mismatch (	/* 1:SFN cannot match the prefix */
+	const BYTE* dir,	/* SFN entry */
+	const WCHAR* pfx,	/* Prefix (up-case) */
+	UINT n				/* Length of the prefix */
+)
+{
+	UINT si, i;
+	BYTE c;
+
+
+	if (dir[DIR_Name] == ' ') return 0;	/* Blank name is decoded to terminate the search */
+	for (si = i = 0; i < n; ) {
+		if (si == 11) return 1;		/* The name is shorter than the prefix */
+		c = dir[si++];
+		if (c == ' ') continue;		/* Skip padding spaces */
+		if (c == RDDEM) c = DDEM;	/* Restore replaced DDEM character */
+		if (si == 9) {				/* A . is inserted before the extension */
+			if (pfx[i++] != '.') return 1;
+			if (i == n) break;
+		}
+		if (c >= 0x80 || pfx[i] >= 0x80) return 0;	/* Not ASCII */
+		if (IsLower(c)) c -= 0x20;
+		if (c != pfx[i++]) return 1;
+	}
+	return 0;
+}
+
+
+#if FF_USE_LFN
+static int lfn_mismatch (	/* 1:LFN cannot match the prefix */
+	const WCHAR* lfn,	/* LFN (null-terminated) */
+	const WCHAR* pfx,	/* Prefix (up-case) */
+	UINT n				/* Length of the prefix */
+)
+{
+	UINT i;
+	int r = 0;
+	WCHAR wc;
+
+
+	for (i = 0; lfn[i]; i++) {
+		wc = lfn[i];
+		if (wc >= 0x80) return 0;	/* The name may be replaced by the SFN if it cannot be put into the API encoding */
+		if (IsLower(wc)) wc -= 0x20;
+		if (i < n && wc != pfx[i]) r = 1;
+	}
+	if (i > FF_LFN_BUF) return 0;	/* The name will be replaced by the SFN */
+	return (i < n) ? 1 : r;
+}
+
+
+#if FF_FS_EXFAT
+static int xname_mismatch (	/* 1:Name in the exFAT entry block cannot match the prefix */
+	const BYTE* dirb,	/* Entry block 85+C0+C1s */
+	const WCHAR* pfx,	/* Prefix (up-case) */
+	UINT n				/* Length of the prefix */
+)
+{
+	UINT i, si, nc = dirb[XDIR_NumName];
+	int r = 0;
+	WCHAR wc;
+
+
+	if (nc == 0) return 0;	/* Blank name is decoded to terminate the search */
+	if (nc > FF_LFN_BUF || MAXDIRB(nc) > MAXDIRB(FF_MAX_LFN)) return 0;	/* Name will be replaced by '?' */
+	for (i = 0, si = SZDIRE * 2; i < nc; i++, si += 2) {
+		if ((si % SZDIRE) == 0) si += 2;	/* Skip entry type field */
+		wc = ld_word(dirb + si);
+		if (wc >= 0x80) return 0;
+		if (IsLower(wc)) wc -= 0x20;
+		if (i < n && wc != pfx[i]) r = 1;
+	}
+	return (i < n) ? 1 : r;
+}
+#endif
+#endif
+
+
+static int cannot_match (	/* 1:The item read by dir_read cannot match the pattern */
+	DIR* dp				/* Directory object with the compiled pattern */
+)
+{
+	UINT n = dp->pfx_len;
+#if FF_USE_LFN
+	FATFS *fs = dp->obj.fs;
+#endif
+
+
+	if (dp->pat_len == 0xFF || n == 0) return 0;	/* No literal prefix to check */
+#if FF_USE_LFN
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) return xname_mismatch(fs->dirbuf, dp->cpat, n);
+#endif
+	if (dp->blk_ofs != 0xFFFFFFFF) {	/* The item has an LFN */
+		if (!lfn_mismatch(fs->lfnbuf, dp->cpat, n)) return 0;
+#if FF_USE_FIND != 2
+		return 1;
+#endif
+	}
+#endif
+	return sfn_mismatch(dp->dir, dp->cpat, n);
+}
+
+#endif /* FF_USE_FIND && FF_FS_MINIMIZE <= 1 */
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Pick a top segment and create the object name in directory form       */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT create_name (	/* FR_OK: successful, FR_INVALID_NAME: could not create */
+	DIR* dp,					/* Pointer to the directory object */
+	const TCHAR** path			/* Pointer to pointer to the segment in the path string */
+)
+{
+#if FF_USE_LFN		/* LFN configuration */
+	BYTE b, cf;
+	WCHAR wc, *lfn;
+	DWORD uc;
+	UINT i, ni, si, di;
+	const TCHAR *p;
+
+
+	/* Create LFN into LFN working buffer */
+	p = *path; lfn = dp->obj.fs->lfnbuf; di = 0;
+	for (;;) {
+		uc = tchar2uni(&p);			/* Get a character */
+		if (uc == 0xFFFFFFFF) return FR_INVALID_NAME;		/* Invalid code or UTF decode error */
+		if (uc >= 0x10000) lfn[di++] = (WCHAR)(uc >> 16);	/* Store high surrogate if needed */
+		wc = (WCHAR)uc;
+		if (wc < ' ' || wc == '/' || wc == '\\') break;	/* Break if end of the path or a separator is found */
+		if (wc < 0x80 && chk_chr("\"*:<>\?|\x7F", wc)) return FR_INVALID_NAME;	/* Reject illegal characters for LFN */
+		if (di >= FF_MAX_LFN) return FR_INVALID_NAME;	/* Reject too long name */
+		lfn[di++] = wc;					/* Store the Unicode character */
+	}
+	while (*p == '/' || *p == '\\') p++;	/* Skip duplicated separators if exist */
+	*path = p;							/* Return pointer to the next segment */
+	cf = (wc < ' ') ? NS_LAST : 0;		/* Set last segment flag if end of the path */
+
+#if FF_FS_RPATH != 0
+	if ((di == 1 && lfn[di - 1] == '.') ||
+		(di == 2 && lfn[di - 1] == '.' && lfn[di - 2] == '.')) {	/* Is this segment a dot name? */
+		lfn[di] = 0;
+		for (i = 0; i < 11; i++) {		/* Create dot name for SFN entry */
+			dp->fn[i] = (i < di) ? '.' : ' ';
+		}
+		dp->fn[i] = cf | NS_DOT;		/* This is a dot entry */
+		return FR_OK;
+	}
+#endif
+	while (di) {						/* Snip off trailing spaces and dots if exist */
+		wc = lfn[di - 1];
+		if (wc != ' ' && wc != '.') break;
+		di--;
+	}
+	lfn[di] = 0;							/* LFN is created into the working buffer */
+	if (di == 0) return FR_INVALID_NAME;	/* Reject null name */
+
+	/* Create SFN in directory form */
+	for (si = 0; lfn[si] == ' '; si++) ;	/* Remove leading spaces */
+	if (si > 0 || lfn[si] == '.') cf |= NS_LOSS | NS_LFN;	/* Is there any leading space or dot? */
+	while (di > 0 && lfn[di - 1] != '.') di--;	/* Find last dot (di<=si: no extension) */
+
+	mem_set(dp->fn, ' ', 11);
+	i = b = 0; ni = 8;
+	for (;;) {
+		wc = lfn[si++];					/* Get an LFN character */
+		if (wc == 0) break;				/* Break on end of the LFN */
 		if (wc == ' ' || (wc == '.' && si != di)) {	/* Remove embedded spaces and dots */
 			cf |= NS_LOSS | NS_LFN;
 			continue;
@@ -2988,6 +4309,8 @@ static FRESULT create_name (	/* FR_OK: successful, FR_INVALID_NAME: could not cr
 		if (ExCvt && c >= 0x80) {		/* Is SBC extended character? */
 			c = ExCvt[c & 0x7F];		/* To upper SBC extended character */
 		}
+#elif FF_CODE_PAGE == 20127
+		if (c >= 0x80) return FR_INVALID_NAME;	/* Reject non-ASCII character */
 #elif FF_CODE_PAGE < 900
 		if (c >= 0x80) {				/* Is SBC extended character? */
 			c = ExCvt[c & 0x7F];		/* To upper SBC extended character */
@@ -3188,6 +4511,9 @@ static BYTE check_fs (	/* 0:FAT, 1:exFAT, 2:Valid BS but not FAT, 3:Not a BS, 4:
 )
 {
 	fs->wflag = 0; fs->winsect = 0xFFFFFFFF;		/* Invaidate window */
+#if WIN_CACHE
+	reset_cache(fs);
+#endif
 	if (move_window(fs, sect) != FR_OK) return 4;	/* Load boot record */
 
 	if (ld_word(fs->win + BS_55AA) != 0xAA55) return 3;	/* Check boot record signature (always here regardless of the sector size) */
@@ -3344,6 +4670,9 @@ static FRESULT find_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 
 #if !FF_FS_READONLY
 		fs->last_clst = fs->free_clst = 0xFFFFFFFF;		/* Initialize cluster allocation information */
+#if FF_USE_CHKVOL
+		fs->scan_clst = 0;
+#endif
 #endif
 		fmt = FS_EXFAT;			/* FAT sub-type */
 	} else
@@ -3404,6 +4733,12 @@ static FRESULT find_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 		/* Get FSInfo if available */
 		fs->last_clst = fs->free_clst = 0xFFFFFFFF;		/* Initialize cluster allocation information */
 		fs->fsi_flag = 0x80;
+#if FF_USE_CHKVOL
+		fs->scan_clst = 0;
+#endif
+#if FF_FAT_MAP_SIZE
+		fmap_init(fs);
+#endif
 #if (FF_FS_NOFSINFO & 3) != 3
 		if (fmt == FS_FAT32				/* Allow to update FSInfo only if BPB_FSInfo32 == 1 */
 			&& ld_word(fs->win + BPB_FSInfo32) == 1
@@ -3428,6 +4763,15 @@ static FRESULT find_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 
 	fs->fs_type = fmt;		/* FAT sub-type */
 	fs->id = ++Fsid;		/* Volume mount ID */
+#if FF_DIR_INDEX
+	fs->dix_stat = 0;		/* No directory is indexed */
+#endif
+#if BUF_POOL
+	reset_pool(fs);			/* Files of the previous mount lost their buffers */
+#endif
+#if BM_WIN
+	fs->bmflag = 0; fs->bmsect = 0xFFFFFFFF;	/* Invalidate allocation bitmap window */
+#endif
 #if FF_USE_LFN == 1
 	fs->lfnbuf = LfnBuf;	/* Static LFN working buffer */
 #if FF_FS_EXFAT
@@ -3682,6 +5026,13 @@ FRESULT f_open (
 			}
 #if FF_USE_FASTSEEK
 			fp->cltbl = 0;			/* Disable fast seek mode */
+#endif
+#if FF_SYNC_POLICY && !FF_FS_READONLY
+			fp->spol = FSY_ALWAYS;	/* Update directory entry on every f_sync */
+#endif
+#if FF_FILE_EXTENTS
+			ext_cut(fp, 0);			/* Clear extent cache */
+			fp->xnext = 0;
 #endif
 			fp->obj.fs = fs;	 	/* Validate the file object */
 			fp->obj.id = fs->id;
@@ -3690,8 +5041,17 @@ FRESULT f_open (
 			fp->sect = 0;			/* Invalidate current data sector */
 			fp->fptr = 0;			/* Set file pointer top of the file */
 #if !FF_FS_READONLY
-#if !FF_FS_TINY
+#if BUF_POOL
+			fp->buf = 0;			/* No sector buffer is taken yet */
+#elif !FF_FS_TINY
 			mem_set(fp->buf, 0, sizeof fp->buf);	/* Clear sector buffer */
+#endif
+#if WR_BEHIND
+			fp->wbuf = 0;			/* No write-behind buffer */
+			fp->wbcnt = 0;
+#endif
+#if FF_USE_REPLACE
+			fp->rstat = 0;			/* Not replaced */
 #endif
 			if ((mode & FA_SEEKEND) && fp->obj.objsize > 0) {	/* Seek to end of file if FA_OPEN_APPEND is specified */
 				fp->fptr = fp->obj.objsize;			/* Offset to seek */
@@ -3708,7 +5068,9 @@ FRESULT f_open (
 						res = FR_INT_ERR;
 					} else {
 						fp->sect = sc + (DWORD)(ofs / SS(fs));
-#if !FF_FS_TINY
+#if BUF_POOL
+						if (take_buf(fp, fp->sect) != FR_OK) res = FR_DISK_ERR;
+#elif !FF_FS_TINY
 						if (disk_read(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) res = FR_DISK_ERR;
 #endif
 					}
@@ -3751,8 +5113,18 @@ FRESULT f_read (
 	res = validate(&fp->obj, &fs);				/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
 	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED); /* Check access mode */
+#if WR_BEHIND
+	if (fp->wbcnt != 0 && flush_wb(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write out the collected sectors first */
+#endif
 	remain = fp->obj.objsize - fp->fptr;
 	if (btr > remain) btr = (UINT)remain;		/* Truncate btr by remaining bytes */
+#if BUF_POOL
+	if (fp->fptr % SS(fs) || btr % SS(fs)) {	/* Partial sector needs a sector buffer */
+		if (take_buf(fp, fp->fptr % SS(fs) ? fp->sect : 0) != FR_OK) ABORT(fs, FR_DISK_ERR);
+	} else {
+		check_buf(fp);
+	}
+#endif
 
 	for ( ;  btr;								/* Repeat until btr bytes read */
 		btr -= rcnt, *br += rcnt, rbuff += rcnt, fp->fptr += rcnt) {
@@ -3763,12 +5135,15 @@ FRESULT f_read (
 					clst = fp->obj.sclust;		/* Follow cluster chain from the origin */
 				} else {						/* Middle or end of the file */
 #if FF_USE_FASTSEEK
-					if (fp->cltbl) {
-						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
-					} else
+					clst = fp->cltbl ? clmt_clust(fp, fp->fptr) : 0;	/* Get cluster# from the CLMT */
+					if (clst == 0)	/* No CLMT or the file has grown beyond it */
 #endif
 					{
+#if FF_FILE_EXTENTS
+						clst = ext_next(fp);	/* Get cluster# from the extent cache or the FAT */
+#else
 						clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+#endif
 					}
 				}
 				if (clst < 2) ABORT(fs, FR_INT_ERR);
@@ -3783,6 +5158,16 @@ FRESULT f_read (
 				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
 					cc = fs->csize - csect;
 				}
+#if FF_USE_DISKIOV && !FF_FS_TINY
+				if (btr - cc * SS(fs) < SS(fs) && btr % SS(fs) && csect + cc < fs->csize && !(fp->flag & FA_DIRTY)) {
+					DSEG seg[2];					/* Read the partial last sector into the sector cache along with them */
+
+					seg[0].buff = rbuff; seg[0].count = cc;
+					seg[1].buff = fp->buf; seg[1].count = 1;
+					if (disk_readv(fs->pdrv, seg, 2, sect) != RES_OK) ABORT(fs, FR_DISK_ERR);
+					fp->sect = sect + cc;
+				} else
+#endif
 				if (disk_read(fs->pdrv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace one of the read sectors with cached data if it contains a dirty sector */
 #if FF_FS_TINY
@@ -3844,6 +5229,11 @@ FRESULT f_write (
 	DWORD clst, sect;
 	UINT wcnt, cc, csect;
 	const BYTE *wbuff = (const BYTE*)buff;
+#if FF_USE_DISKIOV && !FF_FS_TINY
+	DSEG seg[3];
+	UINT sg;
+	DWORD ssect;
+#endif
 
 
 	*bw = 0;	/* Clear write byte counter */
@@ -3855,6 +5245,13 @@ FRESULT f_write (
 	if ((!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) && (DWORD)(fp->fptr + btw) < (DWORD)fp->fptr) {
 		btw = (UINT)(0xFFFFFFFF - (DWORD)fp->fptr);
 	}
+#if BUF_POOL
+	if (fp->fptr % SS(fs) || btw % SS(fs)) {	/* Partial sector needs a sector buffer */
+		if (take_buf(fp, fp->fptr % SS(fs) ? fp->sect : 0) != FR_OK) ABORT(fs, FR_DISK_ERR);
+	} else {
+		check_buf(fp);
+	}
+#endif
 
 	for ( ;  btw;							/* Repeat until all data written */
 		btw -= wcnt, *bw += wcnt, wbuff += wcnt, fp->fptr += wcnt, fp->obj.objsize = (fp->fptr > fp->obj.objsize) ? fp->fptr : fp->obj.objsize) {
@@ -3868,9 +5265,12 @@ FRESULT f_write (
 					}
 				} else {					/* On the middle or end of the file */
 #if FF_USE_FASTSEEK
-					if (fp->cltbl) {
-						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
-					} else
+					clst = fp->cltbl ? clmt_clust(fp, fp->fptr) : 0;	/* Get cluster# from the CLMT */
+					if (clst == 0)	/* No CLMT or out of it, stretch the chain beyond the mapped part */
+#endif
+#if FF_FILE_EXTENTS
+					clst = ext_clust(fp, (DWORD)(fp->fptr / SS(fs) / fs->csize));	/* Get cluster# from the extent cache */
+					if (clst == 0)	/* Not in the cache */
 #endif
 					{
 						clst = create_chain(&fp->obj, fp->clust);	/* Follow or stretch cluster chain on the FAT */
@@ -3880,24 +5280,63 @@ FRESULT f_write (
 				if (clst == 1) ABORT(fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
 				fp->clust = clst;			/* Update current cluster */
+#if FF_FILE_EXTENTS
+				ext_put(fp, (DWORD)(fp->fptr / SS(fs) / fs->csize), clst, 1);
+#endif
 				if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
 			}
+			sect = clst2sect(fs, fp->clust);	/* Get current sector */
+			if (sect == 0) ABORT(fs, FR_INT_ERR);
+			sect += csect;
+			cc = btw / SS(fs);				/* When remaining bytes >= sector size, */
 #if FF_FS_TINY
 			if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back sector cache */
 #else
-			if (fp->flag & FA_DIRTY) {		/* Write-back sector cache */
+#if FF_USE_DISKIOV
+			if ((fp->flag & FA_DIRTY) && !(cc > 0 && fp->sect + 1 == sect))	/* (Unless it can be written along with the following data) */
+#else
+			if (fp->flag & FA_DIRTY)
+#endif
+			{								/* Write-back sector cache */
+#if WR_BEHIND
+				if (fp->wbuf) {
+					if (put_wb(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Collect it in the write-behind buffer */
+				} else
+#endif
 				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
 				fp->flag &= (BYTE)~FA_DIRTY;
 			}
 #endif
-			sect = clst2sect(fs, fp->clust);	/* Get current sector */
-			if (sect == 0) ABORT(fs, FR_INT_ERR);
-			sect += csect;
-			cc = btw / SS(fs);				/* When remaining bytes >= sector size, */
 			if (cc > 0) {					/* Write maximum contiguous sectors directly */
 				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
 					cc = fs->csize - csect;
 				}
+#if WR_BEHIND
+				if (fp->wbcnt != 0 && fp->wbsect < sect + cc
+					&& ((fp->flag & FA_DIRTY) ? fp->sect : sect) < fp->wbsect + fp->wbcnt) {	/* Would the collected sectors overwrite the data later? */
+					if (flush_wb(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);
+				}
+#endif
+#if FF_USE_DISKIOV && !FF_FS_TINY
+				sg = 2;
+				seg[2].buff = (BYTE*)wbuff; seg[2].count = cc;
+				ssect = sect;
+				if (fp->flag & FA_DIRTY) {	/* The sector cache precedes the sectors */
+					sg--; seg[sg].buff = fp->buf; seg[sg].count = 1;
+					ssect = fp->sect;
+				}
+#if WR_BEHIND
+				if (fp->wbcnt != 0 && fp->wbsect + fp->wbcnt == ssect) {	/* The collected sectors precede them */
+					sg--; seg[sg].buff = fp->wbuf; seg[sg].count = fp->wbcnt;
+					ssect = fp->wbsect;
+					fp->wbcnt = 0;
+				}
+#endif
+				if (sg < 2) {	/* Write back the preceding data along with the sectors */
+					if (disk_writev(fs->pdrv, seg + sg, 3 - sg, ssect) != RES_OK) ABORT(fs, FR_DISK_ERR);
+					fp->flag &= (BYTE)~FA_DIRTY;
+				} else
+#endif
 				if (disk_write(fs->pdrv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if FF_FS_MINIMIZE <= 2
 #if FF_FS_TINY
@@ -3921,6 +5360,11 @@ FRESULT f_write (
 				fs->winsect = sect;
 			}
 #else
+#if WR_BEHIND
+			if (fp->wbcnt != 0 && sect - fp->wbsect < fp->wbcnt) {	/* Is the sector to be modified collected in the write-behind buffer? */
+				if (flush_wb(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);
+			}
+#endif
 			if (fp->sect != sect && 		/* Fill sector cache with file data */
 				fp->fptr < fp->obj.objsize &&
 				disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) {
@@ -3942,89 +5386,413 @@ FRESULT f_write (
 	}
 
 	fp->flag |= FA_MODIFIED;				/* Set file change flag */
+#if FF_SYNC_POLICY
+	if (fp->spol == FSY_SIZE) fp->smark += *bw;	/* Count data written since the last directory entry update */
+#endif
 
 	LEAVE_FF(fs, FR_OK);
 }
 
 
-
-
-/*-----------------------------------------------------------------------*/
-/* Synchronize the File                                                  */
-/*-----------------------------------------------------------------------*/
-
-FRESULT f_sync (
-	FIL* fp		/* Pointer to the file object */
+
+
+/*-----------------------------------------------------------------------*/
+/* Synchronize the File                                                  */
+/*-----------------------------------------------------------------------*/
+
+#if FF_SYNC_POLICY
+static int sync_due (	/* 1:Directory entry needs to be updated, 0:It can be deferred */
+	FIL* fp		/* Pointer to the file object */
+)
+{
+	switch (fp->spol) {
+	case FSY_TIME :		/* Has the period elapsed? */
+		return ff_get_ms() - fp->smark >= fp->sarg;
+	case FSY_SIZE :		/* Has enough data been written? */
+		return fp->smark >= fp->sarg;
+	case FSY_FLUSH :	/* Only on f_flush and f_close */
+		return 0;
+	}
+	return 1;
+}
+#endif
+
+
+static FRESULT sync_file (
+	FIL* fp,		/* Pointer to the file object */
+	int force		/* Update the directory entry regardless of the sync policy */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD tm;
+	BYTE *dir;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	if (res == FR_OK) {
+		if (fp->flag & FA_MODIFIED) {	/* Is there any change to the file? */
+#if BUF_POOL
+			check_buf(fp);
+#endif
+#if WR_BEHIND
+			if (fp->wbcnt != 0) {	/* Write back the collected sectors (and the sector cache if it follows them) */
+				if ((fp->flag & FA_DIRTY) && put_wb(fp) != FR_OK) LEAVE_FF(fs, FR_DISK_ERR);
+				if (flush_wb(fp) != FR_OK) LEAVE_FF(fs, FR_DISK_ERR);
+			}
+#endif
+#if !FF_FS_TINY
+			if (fp->flag & FA_DIRTY) {	/* Write-back cached data if needed */
+				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
+				fp->flag &= (BYTE)~FA_DIRTY;
+			}
+#endif
+#if FF_USE_REPLACE
+			if (fp->rstat != 0) {	/* New content of a file being replaced? */
+				/* Write back the allocation of the new content. The directory entry still points
+				/  to the old content and is switched by f_commit(). */
+#if FF_FS_EXFAT
+				if (fs->fs_type == FS_EXFAT) {
+					res = fill_first_frag(&fp->obj);	/* Fill first fragment on the FAT if needed */
+					if (res == FR_OK) {
+						res = fill_last_frag(&fp->obj, fp->clust, 0xFFFFFFFF);	/* Fill last fragment on the FAT if needed */
+					}
+					if (res != FR_OK) LEAVE_FF(fs, res);
+				}
+#endif
+				LEAVE_FF(fs, flush_fs(fs));
+			}
+#endif
+#if FF_SYNC_POLICY
+			if (!force && !sync_due(fp)) {	/* Defer the directory entry update by the sync policy */
+				/* The file data are on the disk. Write back the FAT after them, but leave the directory
+				/  entry (and the FSINFO) as they are, so that it still describes the file as of the last
+				/  update: the data written since then only get lost on a crash, while the clusters allocated
+				/  to them are left as lost chains and the FSINFO free cluster count is just a hint. */
+				LEAVE_FF(fs, flush_fs(fs));
+			}
+			fp->smark = (fp->spol == FSY_TIME) ? ff_get_ms() : 0;	/* Start a new period */
+#else
+			(void)force;
+#endif
+			/* Update the directory entry */
+			tm = GET_FATTIME();				/* Modified time */
+#if FF_FS_EXFAT
+			if (fs->fs_type == FS_EXFAT) {
+				res = fill_first_frag(&fp->obj);	/* Fill first fragment on the FAT if needed */
+				if (res == FR_OK) {
+					res = fill_last_frag(&fp->obj, fp->clust, 0xFFFFFFFF);	/* Fill last fragment on the FAT if needed */
+				}
+				if (res == FR_OK) {
+					DIR dj;
+					DEF_NAMBUF
+
+					INIT_NAMBUF(fs);
+					res = load_obj_xdir(&dj, &fp->obj);	/* Load directory entry block */
+					if (res == FR_OK) {
+						fs->dirbuf[XDIR_Attr] |= AM_ARC;				/* Set archive attribute to indicate that the file has been changed */
+						fs->dirbuf[XDIR_GenFlags] = fp->obj.stat | 1;	/* Update file allocation information */
+						st_dword(fs->dirbuf + XDIR_FstClus, fp->obj.sclust);
+						st_qword(fs->dirbuf + XDIR_FileSize, fp->obj.objsize);
+						st_qword(fs->dirbuf + XDIR_ValidFileSize, fp->obj.objsize);
+						st_dword(fs->dirbuf + XDIR_ModTime, tm);		/* Update modified time */
+						fs->dirbuf[XDIR_ModTime10] = 0;
+						st_dword(fs->dirbuf + XDIR_AccTime, 0);
+						res = store_xdir(&dj);	/* Restore it to the directory */
+						if (res == FR_OK) {
+							res = sync_fs(fs);
+							fp->flag &= (BYTE)~FA_MODIFIED;
+						}
+					}
+					FREE_NAMBUF();
+				}
+			} else
+#endif
+			{
+				res = move_window(fs, fp->dir_sect);
+				if (res == FR_OK) {
+					dir = fp->dir_ptr;
+					dir[DIR_Attr] |= AM_ARC;						/* Set archive attribute to indicate that the file has been changed */
+					st_clust(fp->obj.fs, dir, fp->obj.sclust);		/* Update file allocation information  */
+					st_dword(dir + DIR_FileSize, (DWORD)fp->obj.objsize);	/* Update file size */
+					st_dword(dir + DIR_ModTime, tm);				/* Update modified time */
+					st_word(dir + DIR_LstAccDate, 0);
+					fs->wflag = 1;
+					res = sync_fs(fs);					/* Restore it to the directory */
+					fp->flag &= (BYTE)~FA_MODIFIED;
+				}
+			}
+		}
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+
+FRESULT f_sync (
+	FIL* fp		/* Pointer to the file object */
+)
+{
+	return sync_file(fp, 0);
+}
+
+
+FRESULT f_flush (
+	FIL* fp		/* Pointer to the file object */
+)
+{
+	return sync_file(fp, 1);
+}
+
+
+
+
+#if FF_SYNC_POLICY
+/*-----------------------------------------------------------------------*/
+/* Set Sync Policy of the File                                           */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_setsync (
+	FIL* fp,		/* Pointer to the file object */
+	BYTE pol,		/* Sync policy (FSY_xxx) */
+	DWORD arg		/* Period in ms (FSY_TIME) or amount of data in bytes (FSY_SIZE) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	if (res == FR_OK) {
+		if (pol > FSY_FLUSH) {
+			res = FR_INVALID_PARAMETER;
+		} else {
+			fp->spol = pol;
+			fp->sarg = arg;
+			fp->smark = (pol == FSY_TIME) ? ff_get_ms() : 0;	/* Start a new period */
+		}
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+#endif /* FF_SYNC_POLICY */
+
+
+
+
+#if FF_WRITE_BEHIND
+/*-----------------------------------------------------------------------*/
+/* Set Write-behind Buffer of the File                                   */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_setwbuf (
+	FIL* fp,		/* Pointer to the file object */
+	BYTE* buf,		/* Pointer to the write-behind buffer (null:do not collect sectors) */
+	UINT len		/* Size of the buffer [bytes] */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+#if WR_BEHIND
+	if (res == FR_OK) res = flush_wb(fp);	/* Write out the sectors collected in the current buffer */
+	if (res == FR_OK) {
+		len /= SS(fs);
+		fp->wbuf = (buf && len >= 2) ? buf : 0;	/* A buffer of a sector would only add a copy */
+		fp->wbsz = len;
+	}
+#else
+	(void)buf; (void)len;
+#endif
+
+	LEAVE_FF(fs, res);
+}
+
+#endif /* FF_WRITE_BEHIND */
+
+
+
+
+#if FF_USE_REPLACE
+/*-----------------------------------------------------------------------*/
+/* Replace File Content Atomically                                       */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT replace_start (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp			/* File object to write the new content to */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);
+	if (res == FR_OK) {
+		fp->rclust = fp->obj.sclust;	/* Keep the old content where the directory entry points */
+		fp->rsize = fp->obj.objsize;
+		fp->rstat = 1;
+#if FF_FS_EXFAT
+		fp->rstat += fp->obj.stat;
+		fp->obj.stat = 0;
+		fp->obj.n_cont = fp->obj.n_frag = 0;
+#endif
+		fp->obj.sclust = 0;				/* Start the new content on a new chain */
+		fp->obj.objsize = 0;
+		fp->fptr = 0;
+		fp->clust = 0;
+		fp->sect = 0;
+#if FF_FILE_EXTENTS
+		ext_cut(fp, 0);
+#endif
+	}
+	LEAVE_FF(fs, res);
+}
+
+
+static FRESULT replace_switch (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp			/* File object with the new content on the disk */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	FFOBJID obj;
+	DWORD tm;
+
+
+	res = validate(&fp->obj, &fs);
+	if (res == FR_OK) res = (FRESULT)fp->err;	/* Do not switch to content that failed to be written */
+	if (res == FR_OK && fp->rstat != 0) {
+		tm = GET_FATTIME();
+#if FF_FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {
+			DIR dj;
+			DEF_NAMBUF
+
+			INIT_NAMBUF(fs);
+			res = load_obj_xdir(&dj, &fp->obj);	/* Load directory entry block */
+			if (res == FR_OK) {
+				fs->dirbuf[XDIR_Attr] |= AM_ARC;
+				fs->dirbuf[XDIR_GenFlags] = fp->obj.stat | 1;
+				st_dword(fs->dirbuf + XDIR_FstClus, fp->obj.sclust);
+				st_qword(fs->dirbuf + XDIR_FileSize, fp->obj.objsize);
+				st_qword(fs->dirbuf + XDIR_ValidFileSize, fp->obj.objsize);
+				st_dword(fs->dirbuf + XDIR_ModTime, tm);
+				fs->dirbuf[XDIR_ModTime10] = 0;
+				st_dword(fs->dirbuf + XDIR_AccTime, 0);
+				res = store_xdir(&dj);
+			}
+			FREE_NAMBUF();
+		} else
+#endif
+		{
+			res = move_window(fs, fp->dir_sect);
+			if (res == FR_OK) {
+				fp->dir_ptr[DIR_Attr] |= AM_ARC;
+				st_clust(fs, fp->dir_ptr, fp->obj.sclust);
+				st_dword(fp->dir_ptr + DIR_FileSize, (DWORD)fp->obj.objsize);
+				st_dword(fp->dir_ptr + DIR_ModTime, tm);
+				st_word(fp->dir_ptr + DIR_LstAccDate, 0);
+				fs->wflag = 1;
+			}
+		}
+		/* The new content and its allocation are on the disk already, thus this is the only write
+		/  that switches the file. The old chain is released only after it has reached the disk, so
+		/  that a crash leaves either of the contents and at most a lost chain. */
+		if (res == FR_OK) res = flush_fs(fs);
+		if (res == FR_OK) {
+			fp->flag &= (BYTE)~FA_MODIFIED;
+			obj = fp->obj;
+			obj.sclust = fp->rclust;
+			obj.objsize = fp->rsize;
+#if FF_FS_EXFAT
+			obj.stat = fp->rstat - 1;
+			obj.n_cont = obj.n_frag = 0;
+#endif
+			fp->rstat = 0;
+			if (obj.sclust != 0) res = remove_chain(&obj, obj.sclust, 0);	/* Release the old chain */
+			if (res == FR_OK) res = sync_fs(fs);
+		}
+	}
+	LEAVE_FF(fs, res);
+}
+
+
+static FRESULT replace_cancel (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp			/* File object with the new content */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	FFOBJID obj;
+
+
+	res = validate(&fp->obj, &fs);
+	if (res == FR_OK && fp->rstat != 0) {	/* Is the file still on the old content? */
+#if BUF_POOL
+		check_buf(fp);
+#endif
+#if WR_BEHIND
+		fp->wbcnt = 0;		/* Discard the data not written yet */
+#endif
+		fp->flag &= (BYTE)~(FA_DIRTY | FA_MODIFIED);
+		obj = fp->obj;
+		fp->obj.sclust = fp->rclust;	/* Back to the old content */
+		fp->obj.objsize = fp->rsize;
+#if FF_FS_EXFAT
+		fp->obj.stat = fp->rstat - 1;
+		fp->obj.n_cont = fp->obj.n_frag = 0;
+#endif
+		fp->rstat = 0;
+		fp->fptr = 0;
+		fp->clust = 0;
+		fp->sect = 0;
+#if FF_FILE_EXTENTS
+		ext_cut(fp, 0);
+#endif
+		if (obj.sclust != 0) {
+			res = remove_chain(&obj, obj.sclust, 0);	/* Release the new chain */
+			if (res == FR_OK) res = sync_fs(fs);
+		}
+	}
+	LEAVE_FF(fs, res);
+}
+
+
+FRESULT f_replace (
+	FIL* fp,			/* Pointer to the blank file object */
+	const TCHAR* path	/* Pointer to the file name */
 )
 {
 	FRESULT res;
-	FATFS *fs;
-	DWORD tm;
-	BYTE *dir;
 
 
-	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	res = f_open(fp, path, FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
 	if (res == FR_OK) {
-		if (fp->flag & FA_MODIFIED) {	/* Is there any change to the file? */
-#if !FF_FS_TINY
-			if (fp->flag & FA_DIRTY) {	/* Write-back cached data if needed */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
-				fp->flag &= (BYTE)~FA_DIRTY;
-			}
-#endif
-			/* Update the directory entry */
-			tm = GET_FATTIME();				/* Modified time */
-#if FF_FS_EXFAT
-			if (fs->fs_type == FS_EXFAT) {
-				res = fill_first_frag(&fp->obj);	/* Fill first fragment on the FAT if needed */
-				if (res == FR_OK) {
-					res = fill_last_frag(&fp->obj, fp->clust, 0xFFFFFFFF);	/* Fill last fragment on the FAT if needed */
-				}
-				if (res == FR_OK) {
-					DIR dj;
-					DEF_NAMBUF
-
-					INIT_NAMBUF(fs);
-					res = load_obj_xdir(&dj, &fp->obj);	/* Load directory entry block */
-					if (res == FR_OK) {
-						fs->dirbuf[XDIR_Attr] |= AM_ARC;				/* Set archive attribute to indicate that the file has been changed */
-						fs->dirbuf[XDIR_GenFlags] = fp->obj.stat | 1;	/* Update file allocation information */
-						st_dword(fs->dirbuf + XDIR_FstClus, fp->obj.sclust);
-						st_qword(fs->dirbuf + XDIR_FileSize, fp->obj.objsize);
-						st_qword(fs->dirbuf + XDIR_ValidFileSize, fp->obj.objsize);
-						st_dword(fs->dirbuf + XDIR_ModTime, tm);		/* Update modified time */
-						fs->dirbuf[XDIR_ModTime10] = 0;
-						st_dword(fs->dirbuf + XDIR_AccTime, 0);
-						res = store_xdir(&dj);	/* Restore it to the directory */
-						if (res == FR_OK) {
-							res = sync_fs(fs);
-							fp->flag &= (BYTE)~FA_MODIFIED;
-						}
-					}
-					FREE_NAMBUF();
-				}
-			} else
-#endif
-			{
-				res = move_window(fs, fp->dir_sect);
-				if (res == FR_OK) {
-					dir = fp->dir_ptr;
-					dir[DIR_Attr] |= AM_ARC;						/* Set archive attribute to indicate that the file has been changed */
-					st_clust(fp->obj.fs, dir, fp->obj.sclust);		/* Update file allocation information  */
-					st_dword(dir + DIR_FileSize, (DWORD)fp->obj.objsize);	/* Update file size */
-					st_dword(dir + DIR_ModTime, tm);				/* Update modified time */
-					st_word(dir + DIR_LstAccDate, 0);
-					fs->wflag = 1;
-					res = sync_fs(fs);					/* Restore it to the directory */
-					fp->flag &= (BYTE)~FA_MODIFIED;
-				}
-			}
-		}
+		if (fp->flag & FA_MODIFIED) res = sync_file(fp, 1);	/* Register a new file before its content */
+		if (res == FR_OK) res = replace_start(fp);
+		if (res != FR_OK) f_close(fp);
 	}
+	return res;
+}
 
-	LEAVE_FF(fs, res);
+
+FRESULT f_commit (
+	FIL* fp			/* Pointer to the file object with the new content */
+)
+{
+	FRESULT res, rc;
+
+
+	res = sync_file(fp, 1);						/* Write the new content and its allocation */
+	if (res == FR_OK) res = replace_switch(fp);	/* Switch the directory entry to it */
+	rc = f_close(fp);	/* Discards the new content if it has not been switched */
+	return (res != FR_OK) ? res : rc;
 }
 
+#endif /* FF_USE_REPLACE */
 #endif /* !FF_FS_READONLY */
 
 
@@ -4042,12 +5810,19 @@ FRESULT f_close (
 	FATFS *fs;
 
 #if !FF_FS_READONLY
-	res = f_sync(fp);					/* Flush cached data */
+#if FF_USE_REPLACE
+	res = replace_cancel(fp);			/* Discard the new content of a file not committed */
+	if (res == FR_OK)
+#endif
+	res = sync_file(fp, 1);				/* Flush cached data and update the directory entry */
 	if (res == FR_OK)
 #endif
 	{
 		res = validate(&fp->obj, &fs);	/* Lock volume */
 		if (res == FR_OK) {
+#if BUF_POOL
+			free_buf(fp);				/* Return the sector buffer to the pool */
+#endif
 #if FF_FS_LOCK != 0
 			res = dec_lock(fp->obj.lockid);		/* Decrement file open counter */
 			if (res == FR_OK) fp->obj.fs = 0;	/* Invalidate file object */
@@ -4256,10 +6031,13 @@ FRESULT f_lseek (
 {
 	FRESULT res;
 	FATFS *fs;
-	DWORD clst, bcs, nsect;
+	DWORD clst, bcs, nsect, nc, pcl;
 	FSIZE_t ifptr;
+#if FF_FILE_EXTENTS
+	DWORD ci;
+#endif
 #if FF_USE_FASTSEEK
-	DWORD cl, pcl, ncl, tcl, dsc, tlen, ulen, *tbl;
+	DWORD cl, ncl, tcl, dsc, tlen, ulen, *tbl;
 #endif
 
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
@@ -4270,9 +6048,13 @@ FRESULT f_lseek (
 	}
 #endif
 	if (res != FR_OK) LEAVE_FF(fs, res);
+#if WR_BEHIND
+	if (fp->wbcnt != 0 && flush_wb(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write out the collected sectors first */
+#endif
 
 #if FF_USE_FASTSEEK
-	if (fp->cltbl) {	/* Fast seek */
+	if (fp->cltbl && ofs != CREATE_LINKMAP && ofs > fp->obj.objsize) ofs = fp->obj.objsize;	/* Clip offset at the file size */
+	if (fp->cltbl && (ofs == CREATE_LINKMAP || ofs == 0 || clmt_clust(fp, ofs - 1) != 0)) {	/* Fast seek (the FAT is followed beyond the end of the CLMT) */
 		if (ofs == CREATE_LINKMAP) {	/* Create CLMT */
 			tbl = fp->cltbl;
 			tlen = *tbl++; ulen = 2;	/* Given table size and required table size */
@@ -4280,13 +6062,10 @@ FRESULT f_lseek (
 			if (cl != 0) {
 				do {
 					/* Get a fragment */
-					tcl = cl; ncl = 0; ulen += 2;	/* Top, length and used items */
-					do {
-						pcl = cl; ncl++;
-						cl = get_fat(&fp->obj, cl);
-						if (cl <= 1) ABORT(fs, FR_INT_ERR);
-						if (cl == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
-					} while (cl == pcl + 1);
+					tcl = cl; ulen += 2;	/* Top and used items */
+					ncl = get_run(&fp->obj, cl, fs->n_fatent, &cl);	/* Length of the fragment and the link from it */
+					if (cl <= 1) ABORT(fs, FR_INT_ERR);
+					if (cl == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
 					if (ulen <= tlen) {		/* Store the length and top of the fragment */
 						*tbl++ = ncl; *tbl++ = tcl;
 					}
@@ -4299,7 +6078,6 @@ FRESULT f_lseek (
 				res = FR_NOT_ENOUGH_CORE;	/* Given table size is smaller than required */
 			}
 		} else {						/* Fast seek */
-			if (ofs > fp->obj.objsize) ofs = fp->obj.objsize;	/* Clip offset at the file size */
 			fp->fptr = ofs;				/* Set file pointer */
 			if (ofs > 0) {
 				fp->clust = clmt_clust(fp, ofs - 1);
@@ -4307,6 +6085,9 @@ FRESULT f_lseek (
 				if (dsc == 0) ABORT(fs, FR_INT_ERR);
 				dsc += (DWORD)((ofs - 1) / SS(fs)) & (fs->csize - 1);
 				if (fp->fptr % SS(fs) && dsc != fp->sect) {	/* Refill sector cache if needed */
+#if BUF_POOL
+					if (take_buf(fp, 0) != FR_OK) ABORT(fs, FR_DISK_ERR);
+#endif
 #if !FF_FS_TINY
 #if !FF_FS_READONLY
 					if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
@@ -4352,11 +6133,22 @@ FRESULT f_lseek (
 #endif
 				fp->clust = clst;
 			}
+#if FF_FILE_EXTENTS
+			if (clst != 0) {
+				ci = (DWORD)((fp->fptr + ofs - 1) / bcs);	/* Index of the destination cluster */
+				pcl = ext_near(fp, &ci);					/* Closest cached cluster at or before it */
+				if (pcl != 0 && (FSIZE_t)ci * bcs > fp->fptr) {	/* Start from it if it is ahead */
+					ofs -= (FSIZE_t)ci * bcs - fp->fptr;
+					fp->fptr = (FSIZE_t)ci * bcs;
+					fp->clust = clst = pcl;
+				}
+			}
+#endif
 			if (clst != 0) {
 				while (ofs > bcs) {						/* Cluster following loop */
-					ofs -= bcs; fp->fptr += bcs;
 #if !FF_FS_READONLY
-					if (fp->flag & FA_WRITE) {			/* Check if in write mode or not */
+					if ((fp->flag & FA_WRITE) && fp->fptr + bcs >= fp->obj.objsize) {	/* Check if in write mode and beyond the file data or not */
+						ofs -= bcs; fp->fptr += bcs;
 						if (FF_FS_EXFAT && fp->fptr > fp->obj.objsize) {	/* No FAT chain object needs correct objsize to generate FAT value */
 							fp->obj.objsize = fp->fptr;
 							fp->flag |= FA_MODIFIED;
@@ -4367,12 +6159,26 @@ FRESULT f_lseek (
 						}
 					} else
 #endif
-					{
-						clst = get_fat(&fp->obj, clst);	/* Follow cluster chain if not in write mode */
+					{									/* Follow runs of contiguous clusters on the FAT */
+						nc = ((ofs - 1) / bcs < MAX_EXFAT) ? (DWORD)((ofs - 1) / bcs) : MAX_EXFAT;	/* Clusters to go */
+#if !FF_FS_READONLY
+						if ((fp->flag & FA_WRITE) && (fp->obj.objsize - 1 - fp->fptr) / bcs < nc) {	/* Do not go beyond the file data in write mode */
+							nc = (DWORD)((fp->obj.objsize - 1 - fp->fptr) / bcs);
+						}
+#endif
+						pcl = clst;
+						nc = get_run(&fp->obj, pcl, nc, &clst);
+#if FF_FILE_EXTENTS
+						ext_put(fp, (DWORD)(fp->fptr / bcs), pcl, nc);	/* Cache the run */
+#endif
+						ofs -= (FSIZE_t)nc * bcs; fp->fptr += (FSIZE_t)nc * bcs;
 					}
 					if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
 					if (clst <= 1 || clst >= fs->n_fatent) ABORT(fs, FR_INT_ERR);
 					fp->clust = clst;
+#if FF_FILE_EXTENTS
+					ext_put(fp, (DWORD)(fp->fptr / bcs), clst, 1);
+#endif
 				}
 				fp->fptr += ofs;
 				if (ofs % SS(fs)) {
@@ -4387,6 +6193,9 @@ FRESULT f_lseek (
 			fp->flag |= FA_MODIFIED;
 		}
 		if (fp->fptr % SS(fs) && nsect != fp->sect) {	/* Fill sector cache if needed */
+#if BUF_POOL
+			if (take_buf(fp, 0) != FR_OK) ABORT(fs, FR_DISK_ERR);
+#endif
 #if !FF_FS_TINY
 #if !FF_FS_READONLY
 			if (fp->flag & FA_DIRTY) {			/* Write-back dirty sector cache */
@@ -4537,6 +6346,80 @@ FRESULT f_readdir (
 
 
 
+#if FF_USE_READDIRV
+/*-----------------------------------------------------------------------*/
+/* Read Directory Entries in Batch                                       */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_readdirv (
+	DIR* dp,			/* Pointer to the open directory object */
+	DIRENT* ent,		/* Pointer to the array of items to fill */
+	UINT nent,			/* Number of items in the array */
+	TCHAR* nbuf,		/* Pointer to the buffer to store the names of the items */
+	UINT sznb,			/* Size of the name buffer in unit of TCHAR (FF_LFN_BUF + 1 at least) */
+	UINT* nr			/* Pointer to the variable to return number of items read (0:end of directory) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	UINT n, len;
+	DWORD dptr, clust, sect;
+	BYTE *dir;
+#if FF_USE_LFN
+	TCHAR altname[FF_SFN_BUF + 1];
+#endif
+	DEF_NAMBUF
+
+
+	*nr = 0;
+	res = validate(&dp->obj, &fs);	/* Check validity of the directory object */
+	if (res == FR_OK && (!ent || !nbuf || sznb < (FF_USE_LFN ? FF_LFN_BUF + 1 : 12 + 1))) res = FR_INVALID_PARAMETER;
+	if (res == FR_OK) {
+		INIT_NAMBUF(fs);
+		for (n = 0; n < nent; n++) {
+			dptr = dp->dptr; clust = dp->clust; sect = dp->sect; dir = dp->dir;	/* Location of the item */
+			res = DIR_READ_FILE(dp);	/* Read an item */
+			if (res != FR_OK) break;
+#if FF_USE_LFN
+			len = (sznb > FF_SFN_BUF) ? get_fname(dp, nbuf, sznb > FF_LFN_BUF ? FF_LFN_BUF + 1 : sznb, altname) : 0;
+#else
+			len = (sznb > 12) ? get_fname(dp, nbuf, sznb, 0) : 0;
+#endif
+			if (len == 0) {		/* The name does not fit in the rest of the name buffer? */
+				dp->dptr = dptr; dp->clust = clust; dp->sect = sect; dp->dir = dir;	/* Read the item again in the next call */
+				break;
+			}
+			ent[n].fname = nbuf;
+			nbuf += len; sznb -= len;
+#if FF_FS_EXFAT
+			if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
+				ent[n].fattrib = fs->dirbuf[XDIR_Attr];
+				ent[n].fsize = (ent[n].fattrib & AM_DIR) ? 0 : ld_qword(fs->dirbuf + XDIR_FileSize);
+				ent[n].ftime = ld_word(fs->dirbuf + XDIR_ModTime + 0);
+				ent[n].fdate = ld_word(fs->dirbuf + XDIR_ModTime + 2);
+			} else
+#endif
+			{								/* On the FAT/FAT32 volume */
+				ent[n].fattrib = dp->dir[DIR_Attr];
+				ent[n].fsize = ld_dword(dp->dir + DIR_FileSize);
+				ent[n].ftime = ld_word(dp->dir + DIR_ModTime + 0);
+				ent[n].fdate = ld_word(dp->dir + DIR_ModTime + 2);
+			}
+			res = dir_next(dp, 0);		/* Increment index for next */
+			if (res != FR_OK) {
+				n++; break;
+			}
+		}
+		if (res == FR_NO_FILE) res = FR_OK;	/* Ignore end of directory */
+		*nr = n;
+		FREE_NAMBUF();
+	}
+	LEAVE_FF(fs, res);
+}
+#endif
+
+
+
 #if FF_USE_FIND
 /*-----------------------------------------------------------------------*/
 /* Find Next File                                                        */
@@ -4548,17 +6431,49 @@ FRESULT f_findnext (
 )
 {
 	FRESULT res;
+	FATFS *fs;
+	int m;
+	DEF_NAMBUF
 
 
-	for (;;) {
-		res = f_readdir(dp, fno);		/* Get a directory item */
-		if (res != FR_OK || !fno || !fno->fname[0]) break;	/* Terminate if any error or end of directory */
-		if (pattern_matching(dp->pat, fno->fname, 0, 0)) break;		/* Test for the file name */
+	res = validate(&dp->obj, &fs);	/* Check validity of the directory object */
+	if (res == FR_OK) {
+		if (!fno) {
+			res = dir_sdi(dp, 0);			/* Rewind the directory object */
+		} else {
+			INIT_NAMBUF(fs);
+			for (;;) {
+				res = DIR_READ_FILE(dp);	/* Get a directory item */
+				if (res == FR_NO_FILE) {	/* End of directory */
+					fno->fname[0] = 0; res = FR_OK;
+					break;
+				}
+				if (res != FR_OK) break;
+				m = 0;
+				if (!cannot_match(dp)) {	/* Test the name only if the prefix matched */
+					get_fileinfo(dp, fno);
+					if (!fno->fname[0]) {	/* A blank name terminates the search */
+						m = 1;
+					} else if (dp->pat_len != 0xFF) {
+						m = match_pattern(dp, fno->fname);	/* Test for the file name */
 #if FF_USE_LFN && FF_USE_FIND == 2
-		if (pattern_matching(dp->pat, fno->altname, 0, 0)) break;	/* Test for alternative name if exist */
+						if (!m) m = match_pattern(dp, fno->altname);	/* Test for alternative name if exist */
 #endif
+					} else {
+						m = pattern_matching(dp->pat, fno->fname, 0, 0);
+#if FF_USE_LFN && FF_USE_FIND == 2
+						if (!m) m = pattern_matching(dp->pat, fno->altname, 0, 0);
+#endif
+					}
+				}
+				res = dir_next(dp, 0);		/* Increment index for next */
+				if (res == FR_NO_FILE) res = FR_OK;	/* Ignore end of directory now */
+				if (res != FR_OK || m) break;
+			}
+			FREE_NAMBUF();
+		}
 	}
-	return res;
+	LEAVE_FF(fs, res);
 }
 
 
@@ -4578,6 +6493,7 @@ FRESULT f_findfirst (
 
 
 	dp->pat = pattern;		/* Save pointer to pattern string */
+	compile_pattern(dp);	/* and compile it */
 	res = f_opendir(dp, path);		/* Open the target directory */
 	if (res == FR_OK) {
 		res = f_findnext(dp, fno);	/* Find the first item */
@@ -4652,13 +6568,23 @@ FRESULT f_getfree (
 		} else {
 			/* Scan FAT to obtain number of free clusters */
 			nfree = 0;
+#if FF_FAT_MAP_SIZE
+			if (fs->fs_type != FS_EXFAT) {
+				mem_set(fs->fmap, 0xFF, FF_FAT_MAP_SIZE);	/* Rebuild the free cluster map as the FAT is scanned */
+			}
+#endif
 			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
 				clst = 2; obj.fs = fs;
 				do {
 					stat = get_fat(&obj, clst);
 					if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
 					if (stat == 1) { res = FR_INT_ERR; break; }
-					if (stat == 0) nfree++;
+					if (stat == 0) {
+						nfree++;
+#if FF_FAT_MAP_SIZE
+						fmap_put(fs, clst, 0);
+#endif
+					}
 				} while (++clst < fs->n_fatent);
 			} else {
 #if FF_FS_EXFAT
@@ -4671,10 +6597,10 @@ FRESULT f_getfree (
 					i = 0;						/* Offset in the sector */
 					do {	/* Counts numbuer of bits with zero in the bitmap */
 						if (i == 0) {
-							res = move_window(fs, sect++);
+							res = move_bitmap(fs, sect++);
 							if (res != FR_OK) break;
 						}
-						for (b = 8, bm = fs->win[i]; b && clst; b--, clst--) {
+						for (b = 8, bm = BMWIN(fs)[i]; b && clst; b--, clst--) {
 							if (!(bm & 1)) nfree++;
 							bm >>= 1;
 						}
@@ -4692,25 +6618,341 @@ FRESULT f_getfree (
 							if (res != FR_OK) break;
 						}
 						if (fs->fs_type == FS_FAT16) {
-							if (ld_word(fs->win + i) == 0) nfree++;
+							stat = ld_word(fs->win + i);
 							i += 2;
 						} else {
-							if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;
+							stat = ld_dword(fs->win + i) & 0x0FFFFFFF;
 							i += 4;
 						}
+						if (stat == 0) {
+							nfree++;
+#if FF_FAT_MAP_SIZE
+							fmap_put(fs, fs->n_fatent - clst, 0);	/* Entry index is n_fatent - clst */
+#endif
+						}
 						i %= SS(fs);
 					} while (--clst);
 				}
 			}
-			*nclst = nfree;			/* Return the free clusters */
-			fs->free_clst = nfree;	/* Now free_clst is valid */
-			fs->fsi_flag |= 1;		/* FAT32: FSInfo is to be updated */
+			*nclst = nfree;			/* Return the free clusters */
+			fs->free_clst = nfree;	/* Now free_clst is valid */
+			fs->fsi_flag |= 1;		/* FAT32: FSInfo is to be updated */
+		}
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+
+
+#if FF_USE_CHKVOL && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Check Volume in Time Slices                                           */
+/*-----------------------------------------------------------------------*/
+/* f_chknext counts the free clusters first. Clusters allocated or freed
+/  between the slices are accounted by scan_adjust, so the count is valid
+/  when it is published. Then, on FAT12/16/32 volumes, the chain heads
+/  (allocated clusters no other cluster links to) are counted with a map
+/  of the link targets in a range of clusters at a time, and the chains
+/  referred by the directory entries are counted by walking the directory
+/  tree. Chain heads without a reference are lost chains. This part needs
+/  a snapshot of the volume, so it starts over when the volume changes. */
+
+static FRESULT chk_load (	/* FR_OK(0):succeeded, !=0:error */
+	FCHK* cp,			/* Volume check object */
+	DWORD* end			/* End of the FAT entries to scan in this step */
+)
+{
+	FATFS *fs = cp->dir.obj.fs;
+	FRESULT res = FR_OK;
+	DWORD n;
+
+
+	if (fs->fs_type == FS_FAT12) {
+		n = SS(fs) * 2 / 3;		/* About as many entries as a sector holds (get_fat loads the sectors) */
+		*end = cp->clst + n;
+	} else {
+		n = SS(fs) / (fs->fs_type == FS_FAT16 ? 2 : 4);	/* Entries in a sector */
+		res = move_window(fs, fs->fatbase + cp->clst / n);	/* Load the FAT sector with the entry */
+		*end = cp->clst - cp->clst % n + n;
+	}
+	if (*end > fs->n_fatent) *end = fs->n_fatent;
+	return res;
+}
+
+
+static DWORD chk_fatent (	/* Value of the FAT entry, 0xFFFFFFFF:Disk error */
+	FCHK* cp,			/* Volume check object */
+	DWORD clst			/* Cluster number in the sector loaded by chk_load */
+)
+{
+	FATFS *fs = cp->dir.obj.fs;
+
+
+	switch (fs->fs_type) {
+	case FS_FAT16 :
+		return ld_word(fs->win + clst * 2 % SS(fs));
+	case FS_FAT32 :
+		return ld_dword(fs->win + clst * 4 % SS(fs)) & 0x0FFFFFFF;
+	}
+	return get_fat(&cp->dir.obj, clst);
+}
+
+
+static void chk_links_start (
+	FCHK* cp			/* Volume check object */
+)
+{
+	cp->phase = 2;
+	cp->gen = cp->dir.obj.fs->chk_gen;
+	cp->clst = cp->base = 2;
+	cp->nalloc = cp->nhead = 0;
+	cp->nlost = 0;
+	mem_set(cp->map, 0, cp->szmap);
+}
+
+
+static FRESULT chk_free (	/* FR_OK(0):succeeded, !=0:error */
+	FCHK* cp,			/* Volume check object */
+	UINT* nsect			/* Number of sectors left in the time slice */
+)
+{
+	FATFS *fs = cp->dir.obj.fs;
+	FRESULT res = FR_OK;
+	DWORD clst = cp->clst, end, stat;
+#if FF_FAT_MAP_SIZE
+	DWORD gmsk = ((DWORD)1 << fs->fmshift) - 1;	/* Cluster group mask */
+#endif
+
+
+	while (*nsect && clst < fs->n_fatent) {
+		(*nsect)--;
+#if FF_FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {	/* exFAT: Count zero bits in a sector of the allocation bitmap */
+			res = move_bitmap(fs, fs->bitbase + (clst - 2) / 8 / SS(fs));
+			if (res != FR_OK) break;
+			end = clst + SS(fs) * 8 - (clst - 2) % (SS(fs) * 8);
+			if (end > fs->n_fatent) end = fs->n_fatent;
+			for ( ; clst < end; clst++) {
+				if (!(BMWIN(fs)[(clst - 2) / 8 % SS(fs)] & (1 << ((clst - 2) % 8)))) fs->scan_free++;
+			}
+			continue;
+		}
+#endif
+		cp->clst = clst;
+		res = chk_load(cp, &end);	/* FAT12/16/32: Count zero entries in a sector of the FAT */
+		if (res != FR_OK) break;
+		for ( ; clst < end; clst++) {
+			stat = chk_fatent(cp, clst);
+			if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+			if (stat == 0) {
+				fs->scan_free++;
+				fs->scan_gfree = 1;
+			}
+#if FF_FAT_MAP_SIZE
+			if ((clst & gmsk) == gmsk || clst == fs->n_fatent - 1) {	/* End of a group? */
+				if (!fs->scan_gfree) fmap_put(fs, clst, 1);	/* Entire group has been counted and there is no free cluster */
+				fs->scan_gfree = 0;
+			}
+#endif
+		}
+		if (res != FR_OK) break;
+	}
+	cp->clst = fs->scan_clst = clst;
+
+	if (res == FR_OK && clst >= fs->n_fatent) {	/* All clusters counted? */
+		cp->nfree = fs->free_clst = fs->scan_free;	/* Publish the number of free clusters */
+		fs->fsi_flag |= 1;		/* FAT32: FSInfo is to be updated */
+		fs->scan_clst = 0;
+		cp->phase = 0;
+		if (fs->fs_type != FS_EXFAT && cp->szmap) chk_links_start(cp);	/* Look for lost chains next */
+	}
+	return res;
+}
+
+
+static FRESULT chk_links (	/* FR_OK(0):succeeded, !=0:error */
+	FCHK* cp,			/* Volume check object */
+	UINT* nsect			/* Number of sectors left in the time slice */
+)
+{
+	FATFS *fs = cp->dir.obj.fs;
+	FRESULT res = FR_OK;
+	DWORD clst, end, stat, bad, nlnk, nbit = (DWORD)cp->szmap * 8;
+
+
+	bad = (fs->fs_type == FS_FAT12) ? 0xFF7 : (fs->fs_type == FS_FAT16) ? 0xFFF7 : 0x0FFFFFF7;
+	while (res == FR_OK && cp->phase == 2) {
+		if (cp->clst >= fs->n_fatent) {	/* All links to the range have been marked? */
+			end = (fs->n_fatent - cp->base < nbit) ? fs->n_fatent - cp->base : nbit;
+			for (clst = nlnk = 0; clst < end; clst++) {	/* Count the clusters linked to */
+				if (cp->map[clst / 8] & (1 << (clst % 8))) nlnk++;
+			}
+			if (cp->nalloc > nlnk) cp->nhead += cp->nalloc - nlnk;	/* Allocated clusters that are not linked to are chain heads */
+			cp->base += nbit;
+			if (cp->base < fs->n_fatent) {	/* Mark the links to the next range */
+				cp->clst = 2; cp->nalloc = 0;
+				mem_set(cp->map, 0, cp->szmap);
+			} else {						/* Walk the directory tree from the root */
+				cp->phase = 3; cp->depth = 0;
+				cp->nref = (fs->fs_type == FS_FAT32) ? 1 : 0;	/* FAT32 root directory is a chain without an entry */
+				cp->dir.obj.sclust = 0;
+				res = dir_sdi(&cp->dir, 0);
+			}
+			continue;
+		}
+		if (*nsect == 0) break;
+		(*nsect)--;
+		res = chk_load(cp, &end);
+		if (res != FR_OK) break;
+		for (clst = cp->clst; clst < end; clst++) {
+			stat = chk_fatent(cp, clst);
+			if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+			if (stat == 0 || stat == bad) continue;		/* Free or bad cluster */
+			if (clst - cp->base < nbit) cp->nalloc++;	/* Allocated cluster in the range */
+			if (stat >= 2 && stat < fs->n_fatent && stat - cp->base < nbit) {	/* Link to a cluster in the range */
+				stat -= cp->base;
+				cp->map[stat / 8] |= (BYTE)(1 << (stat % 8));
+			}
+		}
+		cp->clst = clst;
+	}
+	return res;
+}
+
+
+static FRESULT chk_dirs (	/* FR_OK(0):succeeded, !=0:error */
+	FCHK* cp,			/* Volume check object */
+	UINT* nsect			/* Number of sectors left in the time slice */
+)
+{
+	DIR *dp = &cp->dir;
+	FATFS *fs = dp->obj.fs;
+	FRESULT res = FR_OK;
+	DWORD sect = 0, scl;
+	BYTE c, attr;
+
+
+	for (;;) {
+		if (dp->sect != 0) {			/* In the directory? */
+			if (dp->sect != sect) {		/* Entering a sector */
+				if (*nsect == 0) break;
+				(*nsect)--;
+				sect = dp->sect;
+				res = move_window(fs, sect);
+				if (res != FR_OK) break;
+			}
+			c = dp->dir[DIR_Name];
+			attr = dp->dir[DIR_Attr] & AM_MASK;
+			if (c != 0) {
+				if (c != DDEM && c != '.' && attr != AM_LFN && !(attr & AM_VOL)) {	/* An SFN entry of a file or directory */
+					scl = ld_clust(fs, dp->dir);
+					if (scl != 0) cp->nref++;
+					if ((attr & AM_DIR) && scl >= 2 && scl < fs->n_fatent) {	/* Enter the sub-directory */
+						if (cp->depth == FF_CHK_DEPTH) {
+							cp->nlost = 0xFFFFFFFF;	/* Too deep, lost chains cannot be counted */
+						} else {
+							res = dir_next(dp, 0);	/* Continue the parent from the next entry */
+							if (res != FR_OK && res != FR_NO_FILE) break;
+							cp->stk[cp->depth][0] = dp->obj.sclust;
+							cp->stk[cp->depth][1] = (res == FR_OK) ? dp->dptr : 0xFFFFFFFF;
+							cp->depth++;
+							dp->obj.sclust = scl;
+							res = dir_sdi(dp, 0);
+							if (res != FR_OK) break;
+							continue;
+						}
+					}
+				}
+				res = dir_next(dp, 0);
+				if (res == FR_OK) continue;
+				if (res != FR_NO_FILE) break;
+			}
+		}
+		/* End of the directory */
+		if (cp->depth == 0) {		/* Root directory completed */
+			if (cp->nlost != 0xFFFFFFFF) cp->nlost = (cp->nhead > cp->nref) ? cp->nhead - cp->nref : 0;
+			cp->phase = 0;
+			res = FR_OK;
+			break;
 		}
+		cp->depth--;				/* Return to the parent directory */
+		dp->obj.sclust = cp->stk[cp->depth][0];
+		if (cp->stk[cp->depth][1] == 0xFFFFFFFF) {	/* The sub-directory was its last entry */
+			dp->sect = 0;
+		} else {
+			res = dir_sdi(dp, cp->stk[cp->depth][1]);
+			if (res != FR_OK) break;
+		}
+		sect = 0;
+	}
+	return res;
+}
+
+
+FRESULT f_chkvol (
+	FCHK* cp,			/* Pointer to the blank volume check object */
+	const TCHAR* path,	/* Logical drive number */
+	BYTE* work,			/* Pointer to the work area for the link map (null: do not look for lost chains) */
+	UINT len			/* Size of the work area [bytes] */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = find_volume(&path, &fs, 0);
+	if (res == FR_OK) {
+		cp->dir.obj.fs = fs;
+		cp->dir.obj.id = fs->id;
+		cp->map = work;
+		cp->szmap = work ? len : 0;
+		cp->phase = 1;			/* Count free clusters first */
+		cp->clst = 2;
+		cp->nfree = cp->nlost = 0xFFFFFFFF;
+		fs->scan_clst = 2;		/* Start to account allocation changes */
+		fs->scan_free = 0;
+		fs->scan_gfree = 0;
 	}
+	LEAVE_FF(fs, res);
+}
+
+
+FRESULT f_chknext (
+	FCHK* cp,			/* Pointer to the volume check object */
+	UINT nsect			/* Number of sectors to scan in this time slice */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
 
+	res = validate(&cp->dir.obj, &fs);
+	if (res == FR_OK) {
+		if (cp->phase >= 2 && cp->gen != fs->chk_gen) chk_links_start(cp);	/* Restart the lost chain check if the volume has been changed */
+		if (nsect == 0) nsect = 1;
+		while (res == FR_OK && cp->phase != 0 && nsect != 0) {
+			switch (cp->phase) {
+			case 1 :
+				res = chk_free(cp, &nsect);
+				break;
+			case 2 :
+				res = chk_links(cp, &nsect);
+				break;
+			default :
+				res = chk_dirs(cp, &nsect);
+			}
+		}
+		if (res != FR_OK) {		/* Abort the check */
+			if (cp->phase == 1) fs->scan_clst = 0;
+			cp->phase = 0;
+		}
+	}
 	LEAVE_FF(fs, res);
 }
 
+#endif	/* FF_USE_CHKVOL && !FF_FS_READONLY */
+
 
 
 
@@ -4730,6 +6972,9 @@ FRESULT f_truncate (
 	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
 	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+#if WR_BEHIND
+	if (fp->wbcnt != 0 && flush_wb(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write out the collected sectors first */
+#endif
 
 	if (fp->fptr < fp->obj.objsize) {	/* Process when fptr is not on the eof */
 		if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
@@ -4746,6 +6991,12 @@ FRESULT f_truncate (
 		}
 		fp->obj.objsize = fp->fptr;	/* Set file size to current read/write point */
 		fp->flag |= FA_MODIFIED;
+#if FF_FILE_EXTENTS
+		ext_cut(fp, fp->fptr ? (DWORD)((fp->fptr - 1) / SS(fs) / fs->csize) + 1 : 0);	/* Drop removed clusters from the extent cache */
+#endif
+#if BUF_POOL
+		check_buf(fp);
+#endif
 #if !FF_FS_TINY
 		if (res == FR_OK && (fp->flag & FA_DIRTY)) {
 			if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) {
@@ -5297,6 +7548,8 @@ FRESULT f_setlabel (
 			if (IsLower(wc)) wc -= 0x20;		/* To upper ASCII characters */
 #if FF_CODE_PAGE == 0
 			if (ExCvt && wc >= 0x80) wc = ExCvt[wc - 0x80];	/* To upper extended characters (SBCS cfg) */
+#elif FF_CODE_PAGE == 20127
+			if (wc >= 0x80) wc = 0;		/* Reject non-ASCII characters */
 #elif FF_CODE_PAGE < 900
 			if (wc >= 0x80) wc = ExCvt[wc - 0x80];	/* To upper extended characters (SBCS cfg) */
 #endif
@@ -5360,6 +7613,81 @@ FRESULT f_setlabel (
 
 
 
+#if (FF_USE_EXPAND || FF_USE_DEFRAG) && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Find and Allocate a Contiguous Cluster Block                          */
+/*-----------------------------------------------------------------------*/
+
+static DWORD find_block (	/* 0:No contiguous block, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:First cluster of the block */
+	FFOBJID* obj,		/* Object to find the block for */
+	DWORD stcl,			/* Cluster to start to find (2..) */
+	DWORD tcl			/* Number of clusters required */
+)
+{
+	FATFS *fs = obj->fs;
+	DWORD n, clst, scl, ncl;
+
+
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {
+		return find_bitmap(fs, stcl, tcl);	/* Find a contiguous cluster block on the bitmap */
+	}
+#endif
+	scl = clst = stcl; ncl = 0;
+	for (;;) {	/* Find a contiguous cluster block on the FAT */
+		n = get_fat(obj, clst);
+		if (n == 1 || n == 0xFFFFFFFF) return n;
+		if (++clst >= fs->n_fatent) {	/* Wrap-around (the block cannot span it) */
+			clst = 2;
+			if (n == 0 && ++ncl == tcl) break;
+			scl = clst; ncl = 0;
+		} else if (n == 0) {	/* Is it a free cluster? */
+			if (++ncl == tcl) break;	/* Break if a contiguous cluster block is found */
+		} else {
+			scl = clst; ncl = 0;		/* Not a free cluster */
+		}
+		if (clst == stcl) return 0;		/* No contiguous cluster? */
+	}
+	return scl;
+}
+
+
+static FRESULT alloc_block (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,			/* Filesystem object */
+	DWORD scl,			/* First cluster of the block */
+	DWORD tcl			/* Number of clusters in the block */
+)
+{
+	FRESULT res = FR_OK;
+	DWORD clst, n;
+
+
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {
+		res = change_bitmap(fs, scl, tcl, 1);	/* Mark the cluster block 'in use' */
+	} else
+#endif
+	{
+		for (clst = scl, n = tcl; n && res == FR_OK; clst++, n--) {	/* Create a cluster chain on the FAT */
+			res = put_fat(fs, clst, (n == 1) ? 0xFFFFFFFF : clst + 1);
+		}
+	}
+	if (res == FR_OK) {
+		if (fs->free_clst <= fs->n_fatent - 2) {	/* Update FSINFO */
+			fs->free_clst -= tcl;
+			fs->fsi_flag |= 1;
+		}
+#if FF_USE_CHKVOL
+		scan_adjust(fs, scl, tcl, 0);
+#endif
+	}
+	return res;
+}
+
+#endif /* (FF_USE_EXPAND || FF_USE_DEFRAG) && !FF_FS_READONLY */
+
+
+
 #if FF_USE_EXPAND && !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Allocate a Contiguous Blocks to the File                              */
@@ -5373,73 +7701,69 @@ FRESULT f_expand (
 {
 	FRESULT res;
 	FATFS *fs;
-	DWORD n, clst, stcl, scl, ncl, tcl, lclst;
+	DWORD n, clst, stcl, scl, ncl, tcl, lclst, pclst;
 
 
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
-	if (fsz == 0 || fp->obj.objsize != 0 || !(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);
+	if (fsz <= fp->obj.objsize || !(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);
 #if FF_FS_EXFAT
 	if (fs->fs_type != FS_EXFAT && fsz >= 0x100000000) LEAVE_FF(fs, FR_DENIED);	/* Check if in size limit */
 #endif
 	n = (DWORD)fs->csize * SS(fs);	/* Cluster size */
 	tcl = (DWORD)(fsz / n) + ((fsz & (n - 1)) ? 1 : 0);	/* Number of clusters required */
-	stcl = fs->last_clst; lclst = 0;
+	stcl = fs->last_clst; lclst = 0; pclst = 0;
+	if (fp->obj.sclust != 0) {	/* The file has a chain. Find its last cluster to append the block to. */
+		clst = fp->fptr > 0 ? fp->clust : fp->obj.sclust;	/* Start from the current cluster */
+		ncl = fp->fptr > 0 ? (DWORD)((fp->fptr - 1) / n) + 1 : 1;	/* Number of clusters up to there */
+		for (;;) {
+			pclst = clst;
+			clst = get_fat(&fp->obj, clst);
+			if (clst == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+			if (clst < 2) LEAVE_FF(fs, FR_INT_ERR);
+			if (clst >= fs->n_fatent) break;	/* End of the chain? */
+			ncl++;
+		}
+		if (ncl >= tcl) {	/* Clusters are allocated already (chain is longer than the file) */
+			if (opt) {
+				fp->obj.objsize = fsz;
+				fp->flag |= FA_MODIFIED;
+			}
+			LEAVE_FF(fs, FR_OK);
+		}
+		tcl -= ncl;			/* Number of clusters to append */
+		stcl = pclst + 1;	/* Try to keep the chain contiguous */
+	}
 	if (stcl < 2 || stcl >= fs->n_fatent) stcl = 2;
 
+	scl = find_block(&fp->obj, stcl, tcl);	/* Find a contiguous cluster block */
+	if (scl == 0) res = FR_DENIED;			/* No contiguous cluster block was found */
+	if (scl == 1) res = FR_INT_ERR;
+	if (scl == 0xFFFFFFFF) res = FR_DISK_ERR;
 #if FF_FS_EXFAT
-	if (fs->fs_type == FS_EXFAT) {
-		scl = find_bitmap(fs, stcl, tcl);			/* Find a contiguous cluster block */
-		if (scl == 0) res = FR_DENIED;				/* No contiguous cluster block was found */
-		if (scl == 0xFFFFFFFF) res = FR_DISK_ERR;
-		if (res == FR_OK) {	/* A contiguous free area is found */
-			if (opt) {		/* Allocate it now */
-				res = change_bitmap(fs, scl, tcl, 1);	/* Mark the cluster block 'in use' */
-				lclst = scl + tcl - 1;
-			} else {		/* Set it as suggested point for next allocation */
-				lclst = scl - 1;
-			}
-		}
-	} else
+	if (res == FR_OK && fs->fs_type == FS_EXFAT && pclst != 0 && (fp->obj.stat != 2 || scl != pclst + 1)) {
+		res = FR_DENIED;	/* Appended block would not keep the object contiguous (it has no FAT chain) */
+	}
 #endif
-	{
-		scl = clst = stcl; ncl = 0;
-		for (;;) {	/* Find a contiguous cluster block */
-			n = get_fat(&fp->obj, clst);
-			if (++clst >= fs->n_fatent) clst = 2;
-			if (n == 1) { res = FR_INT_ERR; break; }
-			if (n == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
-			if (n == 0) {	/* Is it a free cluster? */
-				if (++ncl == tcl) break;	/* Break if a contiguous cluster block is found */
-			} else {
-				scl = clst; ncl = 0;		/* Not a free cluster */
-			}
-			if (clst == stcl) { res = FR_DENIED; break; }	/* No contiguous cluster? */
-		}
-		if (res == FR_OK) {	/* A contiguous free area is found */
-			if (opt) {		/* Allocate it now */
-				for (clst = scl, n = tcl; n; clst++, n--) {	/* Create a cluster chain on the FAT */
-					res = put_fat(fs, clst, (n == 1) ? 0xFFFFFFFF : clst + 1);
-					if (res != FR_OK) break;
-					lclst = clst;
-				}
-			} else {		/* Set it as suggested point for next allocation */
-				lclst = scl - 1;
+	if (res == FR_OK) {	/* A contiguous free area is found */
+		if (opt) {		/* Allocate it now */
+			res = alloc_block(fs, scl, tcl);
+			if (res == FR_OK && pclst != 0 && fs->fs_type != FS_EXFAT) {	/* Link the block to the end of the file's chain */
+				res = put_fat(fs, pclst, scl);
 			}
+			lclst = scl + tcl - 1;
+		} else {		/* Set it as suggested point for next allocation */
+			lclst = scl - 1;
 		}
 	}
 
 	if (res == FR_OK) {
 		fs->last_clst = lclst;		/* Set suggested start cluster to start next */
 		if (opt) {	/* Is it allocated now? */
-			fp->obj.sclust = scl;		/* Update object allocation information */
+			if (fp->obj.sclust == 0) fp->obj.sclust = scl;	/* Update object allocation information */
 			fp->obj.objsize = fsz;
 			if (FF_FS_EXFAT) fp->obj.stat = 2;	/* Set status 'contiguous chain' */
 			fp->flag |= FA_MODIFIED;
-			if (fs->free_clst <= fs->n_fatent - 2) {	/* Update FSINFO */
-				fs->free_clst -= tcl;
-				fs->fsi_flag |= 1;
-			}
 		}
 	}
 
@@ -5450,6 +7774,306 @@ FRESULT f_expand (
 
 
 
+#if FF_USE_DEFRAG
+/*-----------------------------------------------------------------------*/
+/* Get Fragmentation of a File or the Volume                             */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT count_frags (	/* FR_OK(0):succeeded, !=0:error */
+	FFOBJID* obj,		/* Object to follow the chain of */
+	DWORD clst,			/* First cluster of the chain */
+	DWORD* nclst,		/* Number of clusters in the chain */
+	DWORD* nfrag		/* Number of fragments of the chain */
+)
+{
+	FATFS *fs = obj->fs;
+	DWORD nxt;
+
+
+	*nclst = *nfrag = 0;
+	while (clst >= 2 && clst < fs->n_fatent) {	/* Follow the chain a run of contiguous clusters at a time */
+		*nclst += get_run(obj, clst, fs->n_fatent, &nxt);
+		if (nxt == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (nxt < 2 || *nclst > fs->n_fatent) return FR_INT_ERR;	/* Broken or circular chain? */
+		(*nfrag)++;
+		clst = nxt;
+	}
+	return FR_OK;
+}
+
+
+FRESULT f_getfrag (
+	FIL* fp,			/* Pointer to the file object */
+	FRAGINFO* fi		/* Pointer to the fragmentation information to be returned */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	if (res == FR_OK) {
+		fi->nchain = 0;
+		fi->nclst = fi->nfrag = 0;
+		if (fp->obj.sclust != 0) {
+			fi->nchain = 1;
+			res = count_frags(&fp->obj, fp->obj.sclust, &fi->nclst, &fi->nfrag);
+		}
+	}
+	LEAVE_FF(fs, res);
+}
+
+
+FRESULT f_getfragvol (
+	const TCHAR* path,	/* Logical drive number */
+	FRAGINFO* fi		/* Pointer to the fragmentation information to be returned */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD clst, stat, bad;
+	FFOBJID obj;
+
+
+	res = find_volume(&path, &fs, 0);
+	if (res == FR_OK) {
+		if (fs->fs_type == FS_EXFAT) {	/* Contiguous files on the exFAT volume have no FAT chain */
+			res = FR_DENIED;
+		} else {
+			obj.fs = fs;
+			bad = (fs->fs_type == FS_FAT12) ? 0xFF7 : (fs->fs_type == FS_FAT16) ? 0xFFF7 : 0x0FFFFFF7;
+			fi->nchain = fi->nclst = fi->nfrag = 0;
+			for (clst = 2; clst < fs->n_fatent; clst++) {	/* Scan the FAT */
+				stat = get_fat(&obj, clst);
+				if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+				if (stat == 1) { res = FR_INT_ERR; break; }
+				if (stat == 0 || stat == bad) continue;		/* Free or bad cluster */
+				fi->nclst++;
+				if (stat >= fs->n_fatent) {	/* End of a chain */
+					fi->nchain++;
+					fi->nfrag++;
+				} else if (stat != clst + 1) {	/* Link to another fragment */
+					fi->nfrag++;
+				}
+			}
+		}
+	}
+	LEAVE_FF(fs, res);
+}
+
+
+
+#if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Move a File into a Contiguous Block in Steps                          */
+/*-----------------------------------------------------------------------*/
+/* The data are copied into a contiguous block allocated on the FAT (or
+/  the bitmap) while the file is still on its old chain. The directory
+/  entry is switched to the block when all data are copied and then the
+/  old chain is removed, so an interruption leaves the file intact and
+/  at worst a lost chain. */
+
+static FRESULT defrag_start (	/* FR_OK(0):succeeded, !=0:error */
+	FDEFRAG* dp,		/* Defragmentation object with the open file */
+	BYTE* work,			/* Work area to copy the data through */
+	UINT len			/* Size of the work area [bytes] */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	FIL *fp = &dp->file;
+	DWORD stcl;
+
+
+	res = validate(&fp->obj, &fs);
+	if (res == FR_OK) {
+		dp->buf = work;
+		dp->szbuf = len / SS(fs);
+		dp->nfrag = dp->ncl = dp->done = 0;
+		dp->dclst = 0;
+		if (dp->szbuf == 0) {
+			res = FR_INVALID_PARAMETER;
+		} else if (fp->obj.sclust != 0) {
+			res = count_frags(&fp->obj, fp->obj.sclust, &dp->ncl, &dp->nfrag);
+		}
+		if (res == FR_OK && dp->nfrag > 1) {	/* Is the file fragmented? */
+			stcl = fs->last_clst;
+			if (stcl < 2 || stcl >= fs->n_fatent) stcl = 2;
+			stcl = find_block(&fp->obj, stcl, dp->ncl);	/* Find a contiguous cluster block for the whole chain */
+			if (stcl == 0) res = FR_DENIED;
+			if (stcl == 1) res = FR_INT_ERR;
+			if (stcl == 0xFFFFFFFF) res = FR_DISK_ERR;
+			if (res == FR_OK) res = alloc_block(fs, stcl, dp->ncl);	/* Allocate it until the file is moved */
+			if (res == FR_OK) {
+				fs->last_clst = stcl + dp->ncl - 1;
+				dp->dclst = stcl;
+				dp->sclst = fp->obj.sclust;
+				dp->nrun = 0;
+				dp->phase = 1;
+			}
+		}
+	}
+	LEAVE_FF(fs, res);
+}
+
+
+static FRESULT defrag_switch (	/* FR_OK(0):succeeded, !=0:error */
+	FDEFRAG* dp			/* Defragmentation object with all data copied */
+)
+{
+	FRESULT res;
+	FIL *fp = &dp->file;
+	FATFS *fs = fp->obj.fs;
+	FFOBJID obj;
+	int sw = 0;
+
+
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {
+		DIR dj;
+		DEF_NAMBUF
+
+		INIT_NAMBUF(fs);
+		res = load_obj_xdir(&dj, &fp->obj);	/* Load directory entry block */
+		if (res == FR_OK) {
+			fs->dirbuf[XDIR_GenFlags] = 2 | 1;	/* Contiguous chain without FAT chain */
+			st_dword(fs->dirbuf + XDIR_FstClus, dp->dclst);
+			sw = 1;		/* The entry block in the window may refer to the block even if it fails to be stored */
+			res = store_xdir(&dj);
+		}
+		FREE_NAMBUF();
+	} else
+#endif
+	{
+		res = move_window(fs, fp->dir_sect);
+		if (res == FR_OK) {
+			st_clust(fs, fp->dir_ptr, dp->dclst);	/* Point the directory entry to the block (the file is not modified) */
+			fs->wflag = 1;
+			sw = 1;
+		}
+	}
+	if (sw) {	/* The file is on the block now. The block must not be released even if the sync fails. */
+		obj = fp->obj;
+		fp->obj.sclust = dp->dclst;
+		if (FF_FS_EXFAT) fp->obj.stat = 2;
+		fp->fptr = 0;
+		fp->sect = 0;
+#if FF_FILE_EXTENTS
+		ext_cut(fp, 0);		/* Drop the extents of the old chain */
+#endif
+		dp->phase = 0;
+		if (res == FR_OK) res = sync_fs(fs);
+		if (res == FR_OK) res = remove_chain(&obj, obj.sclust, 0);	/* Remove the old chain (it is left lost if the entry has not reached the disk) */
+		if (res == FR_OK) res = sync_fs(fs);
+	}
+	return res;
+}
+
+
+FRESULT f_defragopen (
+	FDEFRAG* dp,		/* Pointer to the blank defragmentation object */
+	const TCHAR* path,	/* Pointer to the file name */
+	BYTE* work,			/* Pointer to the work area to copy the data through */
+	UINT len			/* Size of the work area [bytes] (one sector at least) */
+)
+{
+	FRESULT res;
+
+
+	dp->phase = 0;
+	res = f_open(&dp->file, path, FA_READ | FA_WRITE);
+	if (res == FR_OK) {
+		res = defrag_start(dp, work, len);
+		if (res != FR_OK) f_close(&dp->file);
+	}
+	return res;
+}
+
+
+FRESULT f_defragnext (
+	FDEFRAG* dp,		/* Pointer to the defragmentation object */
+	UINT ncl			/* Number of clusters to copy in this step */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	FIL *fp = &dp->file;
+	DWORD sect, dsect, n, cc;
+
+
+	res = validate(&fp->obj, &fs);
+	if (res == FR_OK && dp->phase != 0) {
+		if (ncl == 0) ncl = 1;
+		while (ncl != 0 && dp->done < dp->ncl) {
+			if (dp->nrun == 0) {	/* Get the next run of contiguous clusters of the old chain */
+				if (dp->sclst < 2 || dp->sclst >= fs->n_fatent) { res = FR_INT_ERR; break; }
+				dp->nrun = get_run(&fp->obj, dp->sclst, dp->ncl - dp->done, &dp->nxt);
+				if (dp->nxt == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+				if (dp->nxt < 2) { res = FR_INT_ERR; break; }
+			}
+			n = (dp->nrun < ncl) ? dp->nrun : ncl;	/* Number of clusters to copy now */
+			sect = clst2sect(fs, dp->sclst);
+			dsect = clst2sect(fs, dp->dclst + dp->done);
+			for (n *= fs->csize; n; n -= cc, sect += cc, dsect += cc) {	/* Copy the sectors through the work area */
+				cc = (n < dp->szbuf) ? n : dp->szbuf;
+				if (disk_read(fs->pdrv, dp->buf, sect, (UINT)cc) != RES_OK
+					|| disk_write(fs->pdrv, dp->buf, dsect, (UINT)cc) != RES_OK) {
+					res = FR_DISK_ERR; break;
+				}
+			}
+			if (res != FR_OK) break;
+			n = (dp->nrun < ncl) ? dp->nrun : ncl;
+			dp->done += n; dp->sclst += n; dp->nrun -= n; ncl -= n;
+			if (dp->nrun == 0) dp->sclst = dp->nxt;	/* Continue at the next fragment */
+		}
+		if (res == FR_OK && dp->done == dp->ncl) {	/* All data copied? */
+			res = defrag_switch(dp);
+		}
+	}
+	LEAVE_FF(fs, res);
+}
+
+
+static FRESULT defrag_cancel (	/* FR_OK(0):succeeded, !=0:error */
+	FDEFRAG* dp			/* Defragmentation object */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	FFOBJID obj;
+
+
+	res = validate(&dp->file.obj, &fs);
+	if (res == FR_OK && dp->phase != 0) {	/* Is the file still on the old chain? */
+		obj = dp->file.obj;
+		obj.sclust = dp->dclst;
+		obj.objsize = (FSIZE_t)dp->ncl * fs->csize * SS(fs);
+		obj.stat = 2;
+		res = remove_chain(&obj, dp->dclst, 0);	/* Release the block */
+		if (res == FR_OK) res = sync_fs(fs);
+		dp->phase = 0;
+	}
+	LEAVE_FF(fs, res);
+}
+
+
+FRESULT f_defragclose (
+	FDEFRAG* dp			/* Pointer to the defragmentation object to be closed */
+)
+{
+	FRESULT res, rc;
+
+
+	res = defrag_cancel(dp);
+	rc = f_close(&dp->file);
+	return (res != FR_OK) ? res : rc;
+}
+
+#endif /* !FF_FS_READONLY */
+#endif /* FF_USE_DEFRAG */
+
+
+
 #if FF_USE_FORWARD
 /*-----------------------------------------------------------------------*/
 /* Forward Data to the Stream Directly                                   */
@@ -5474,17 +8098,36 @@ FRESULT f_forward (
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
 	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+#if WR_BEHIND
+	if (fp->wbcnt != 0 && flush_wb(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write out the collected sectors first */
+#endif
 
 	remain = fp->obj.objsize - fp->fptr;
 	if (btf > remain) btf = (UINT)remain;			/* Truncate btf by remaining bytes */
+#if BUF_POOL
+	if (btf && take_buf(fp, fp->fptr % SS(fs) ? fp->sect : 0) != FR_OK) ABORT(fs, FR_DISK_ERR);
+#endif
 
 	for ( ;  btf && (*func)(0, 0);					/* Repeat until all data transferred or stream goes busy */
 		fp->fptr += rcnt, *bf += rcnt, btf -= rcnt) {
 		csect = (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));	/* Sector offset in the cluster */
 		if (fp->fptr % SS(fs) == 0) {				/* On the sector boundary? */
 			if (csect == 0) {						/* On the cluster boundary? */
-				clst = (fp->fptr == 0) ?			/* On the top of the file? */
-					fp->obj.sclust : get_fat(&fp->obj, fp->clust);
+				if (fp->fptr == 0) {				/* On the top of the file? */
+					clst = fp->obj.sclust;
+				} else {
+#if FF_USE_FASTSEEK
+					clst = fp->cltbl ? clmt_clust(fp, fp->fptr) : 0;	/* Get cluster# from the CLMT */
+					if (clst == 0)	/* No CLMT or the file has grown beyond it */
+#endif
+					{
+#if FF_FILE_EXTENTS
+						clst = ext_next(fp);
+#else
+						clst = get_fat(&fp->obj, fp->clust);
+#endif
+					}
+				}
 				if (clst <= 1) ABORT(fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
 				fp->clust = clst;					/* Update current cluster */
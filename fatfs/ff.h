@@ -144,6 +144,27 @@ typedef struct {
 #if !FF_FS_READONLY
 	DWORD	last_clst;		/* Last allocated cluster */
 	DWORD	free_clst;		/* Number of free clusters */
+#if FF_FAT_MAP_SIZE
+	BYTE	fmshift;		/* Size of a cluster group in the free cluster map [log2(clusters)] */
+	BYTE	fmap[FF_FAT_MAP_SIZE];	/* Free cluster map (bit set: the group has no free cluster) */
+#endif
+#if FF_USE_CHKVOL
+	BYTE	scan_gfree;		/* The group being counted by f_chknext() has a free cluster */
+	WORD	chk_gen;		/* Count of changes to the FAT and directories (lost chain check restarts when it changes) */
+	DWORD	scan_clst;		/* Clusters below this one have been counted by f_chknext() (0:no count in progress) */
+	DWORD	scan_free;		/* Number of free clusters below scan_clst */
+#endif
+#endif
+#if FF_DIR_INDEX
+	BYTE	dix_stat;		/* Directory index status (0:invalid, 1:valid, 2:directory is too large) */
+	WORD	dix_cnt;		/* Number of used slots in the directory index */
+	DWORD	dix_clst;		/* Start cluster of the indexed directory (0:root) */
+	DWORD	dix[FF_DIR_INDEX];	/* Directory index slots (b31-b16:name hash, b15-b0:entry block index) */
+#endif
+#if FF_BUF_POOL && !FF_FS_TINY
+	void*	fbown[FF_BUF_POOL];	/* File objects owning the pool buffers (0:free) */
+	BYTE	fbuf[FF_BUF_POOL][FF_MAX_SS];	/* File buffer pool */
+	BYTE	fbord[FF_BUF_POOL];	/* Pool buffers in order of use (fbord[0]:most recent) */
 #endif
 #if FF_FS_RPATH
 	DWORD	cdir;			/* Current directory start cluster (0:root) */
@@ -161,9 +182,20 @@ typedef struct {
 	DWORD	database;		/* Data base sector */
 #if FF_FS_EXFAT
 	DWORD	bitbase;		/* Allocation bitmap base sector */
+#endif
+#if FF_FS_EXFAT && !FF_FS_TINY
+	BYTE	bmflag;			/* bmwin[] flag (b0:dirty) */
+	DWORD	bmsect;			/* Allocation bitmap sector appearing in the bmwin[] */
+	BYTE	bmwin[FF_MAX_SS];	/* Allocation bitmap window (exFAT) */
 #endif
 	DWORD	winsect;		/* Current sector appearing in the win[] */
 	BYTE	win[FF_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
+#if FF_WIN_CACHE > 1 && !FF_FS_TINY
+	BYTE	wcbuf[FF_WIN_CACHE - 1][FF_MAX_SS];	/* Window cache buffers (sectors recently swapped out of the win[]) */
+	DWORD	wcsect[FF_WIN_CACHE - 1];	/* Sectors in the window cache buffers */
+	BYTE	wcflag[FF_WIN_CACHE - 1];	/* Window cache buffer flags (b0:dirty) */
+	BYTE	wcord[FF_WIN_CACHE - 1];	/* Window cache buffers in order of use (wcord[0]:most recent) */
+#endif
 } FATFS;
 
 
@@ -207,9 +239,35 @@ typedef struct {
 #if FF_USE_FASTSEEK
 	DWORD*	cltbl;			/* Pointer to the cluster link map table (nulled on open, set by application) */
 #endif
+#if FF_SYNC_POLICY && !FF_FS_READONLY
+	BYTE	spol;			/* Sync policy (FSY_xxx) */
+	DWORD	sarg;			/* Sync policy argument (period in ms or amount of data in bytes) */
+	DWORD	smark;			/* Time of the last directory entry update or bytes written after it */
+#endif
+#if FF_WRITE_BEHIND && !FF_FS_READONLY && !FF_FS_TINY
+	BYTE*	wbuf;			/* Write-behind buffer (0:not used, set by application) */
+	UINT	wbsz;			/* Size of the write-behind buffer [sectors] */
+	UINT	wbcnt;			/* Number of sectors collected in the write-behind buffer */
+	DWORD	wbsect;			/* Sector number of the first collected sector */
+#endif
+#if FF_USE_REPLACE && !FF_FS_READONLY
+	BYTE	rstat;			/* Replacement status (0:not replaced, else 1 + chain status of the old content) */
+	DWORD	rclust;			/* Start cluster of the old content */
+	FSIZE_t	rsize;			/* Size of the old content */
+#endif
+#if FF_FILE_EXTENTS
+	DWORD	xcidx[FF_FILE_EXTENTS];	/* Extent cache - Index of the first cluster in the file */
+	DWORD	xclst[FF_FILE_EXTENTS];	/* Extent cache - First cluster of the extent */
+	DWORD	xncl[FF_FILE_EXTENTS];	/* Extent cache - Number of clusters in the extent (0:unused) */
+	BYTE	xnext;			/* Extent cache - Entry to be replaced next */
+#endif
 #if !FF_FS_TINY
+#if FF_BUF_POOL
+	BYTE*	buf;			/* Pointer to the data read/write window taken from the pool (0:no buffer) */
+#else
 	BYTE	buf[FF_MAX_SS];	/* File private data read/write window */
 #endif
+#endif
 } FIL;
 
 
@@ -228,6 +286,9 @@ typedef struct {
 #endif
 #if FF_USE_FIND
 	const TCHAR* pat;		/* Pointer to the name matching pattern */
+	BYTE	pat_len;		/* Length of the compiled pattern (0xFF:pattern is not compiled) */
+	BYTE	pfx_len;		/* Length of the literal prefix of the compiled pattern */
+	WCHAR	cpat[FF_FIND_PAT];	/* Compiled pattern (up-case characters, '?' and '*') */
 #endif
 } DIR;
 
@@ -250,6 +311,67 @@ typedef struct {
 
 
 
+/* Compact directory item structure (DIRENT) */
+
+typedef struct {
+	FSIZE_t	fsize;			/* File size */
+	WORD	fdate;			/* Modified date */
+	WORD	ftime;			/* Modified time */
+	BYTE	fattrib;		/* File attribute */
+	const TCHAR* fname;		/* File name (primary name stored in the name buffer given to f_readdirv) */
+} DIRENT;
+
+
+
+/* Volume check object structure (FCHK) */
+
+typedef struct {
+	DIR		dir;			/* Directory being walked (dir.obj identifies the volume) */
+	BYTE	phase;			/* Check phase (0:completed, 1:counting free clusters, 2:scanning cluster links, 3:walking directories) */
+	BYTE	depth;			/* Current depth of the directory walk */
+	WORD	gen;			/* Change count of the volume when the lost chain check started */
+	DWORD	clst;			/* Next FAT entry (allocation bit) to scan */
+	DWORD	base;			/* First cluster of the range covered by the link map */
+	DWORD	nalloc;			/* Number of allocated clusters in the range */
+	DWORD	nhead;			/* Number of chain heads found so far */
+	DWORD	nref;			/* Number of chains referred by the directory entries walked so far */
+	BYTE*	map;			/* Link map (0:lost chains are not checked) */
+	UINT	szmap;			/* Size of the link map [bytes] */
+	DWORD	stk[FF_CHK_DEPTH][2];	/* Parent directories (start cluster, offset of the entry to continue from) */
+	DWORD	nfree;			/* Number of free clusters (valid when completed) */
+	DWORD	nlost;			/* Number of lost cluster chains (valid when completed, 0xFFFFFFFF:not checked) */
+} FCHK;
+
+
+
+/* Fragmentation information structure (FRAGINFO) */
+
+typedef struct {
+	DWORD	nchain;			/* Number of cluster chains */
+	DWORD	nclst;			/* Number of clusters in the chains */
+	DWORD	nfrag;			/* Number of fragments (runs of contiguous clusters) in the chains */
+} FRAGINFO;
+
+
+
+/* Defragmentation object structure (FDEFRAG) */
+
+typedef struct {
+	FIL		file;			/* File being moved (file.obj identifies the volume) */
+	BYTE	phase;			/* 0:completed or nothing to move, 1:copying */
+	BYTE*	buf;			/* Work area to copy the data through */
+	UINT	szbuf;			/* Size of the work area [sectors] */
+	DWORD	nfrag;			/* Number of fragments of the file when it was opened */
+	DWORD	ncl;			/* Number of clusters to move */
+	DWORD	done;			/* Number of clusters copied */
+	DWORD	dclst;			/* First cluster of the destination block */
+	DWORD	sclst;			/* Next cluster of the old chain to copy */
+	DWORD	nrun;			/* Number of contiguous clusters left from sclst */
+	DWORD	nxt;			/* Cluster the run of sclst links to */
+} FDEFRAG;
+
+
+
 /* File function return code (FRESULT) */
 
 typedef enum {
@@ -287,9 +409,13 @@ FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data t
 FRESULT f_lseek (FIL* fp, FSIZE_t ofs);								/* Move file pointer of the file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate the file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of the writing file */
+FRESULT f_flush (FIL* fp);											/* Flush cached data and update the directory entry regardless of the sync policy */
+FRESULT f_setsync (FIL* fp, BYTE pol, DWORD arg);					/* Set sync policy of the file */
+FRESULT f_setwbuf (FIL* fp, BYTE* buf, UINT len);					/* Set write-behind buffer of the file */
 FRESULT f_opendir (DIR* dp, const TCHAR* path);						/* Open a directory */
 FRESULT f_closedir (DIR* dp);										/* Close an open directory */
 FRESULT f_readdir (DIR* dp, FILINFO* fno);							/* Read a directory item */
+FRESULT f_readdirv (DIR* dp, DIRENT* ent, UINT nent, TCHAR* nbuf, UINT sznb, UINT* nr);	/* Read directory items in a batch */
 FRESULT f_findfirst (DIR* dp, FILINFO* fno, const TCHAR* path, const TCHAR* pattern);	/* Find first file */
 FRESULT f_findnext (DIR* dp, FILINFO* fno);							/* Find next file */
 FRESULT f_mkdir (const TCHAR* path);								/* Create a sub directory */
@@ -302,10 +428,19 @@ FRESULT f_chdir (const TCHAR* path);								/* Change current directory */
 FRESULT f_chdrive (const TCHAR* path);								/* Change current drive */
 FRESULT f_getcwd (TCHAR* buff, UINT len);							/* Get current directory */
 FRESULT f_getfree (const TCHAR* path, DWORD* nclst, FATFS** fatfs);	/* Get number of free clusters on the drive */
+FRESULT f_chkvol (FCHK* cp, const TCHAR* path, BYTE* work, UINT len);	/* Start checking the volume */
+FRESULT f_chknext (FCHK* cp, UINT nsect);							/* Continue checking the volume for a time slice */
 FRESULT f_getlabel (const TCHAR* path, TCHAR* label, DWORD* vsn);	/* Get volume label */
 FRESULT f_setlabel (const TCHAR* label);							/* Set volume label */
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
 FRESULT f_expand (FIL* fp, FSIZE_t szf, BYTE opt);					/* Allocate a contiguous block to the file */
+FRESULT f_getfrag (FIL* fp, FRAGINFO* fi);							/* Get fragmentation of the file */
+FRESULT f_getfragvol (const TCHAR* path, FRAGINFO* fi);				/* Get fragmentation of the cluster chains on the drive */
+FRESULT f_defragopen (FDEFRAG* dp, const TCHAR* path, BYTE* work, UINT len);	/* Open a file to move it into a contiguous block */
+FRESULT f_defragnext (FDEFRAG* dp, UINT ncl);						/* Copy the next clusters of the file */
+FRESULT f_defragclose (FDEFRAG* dp);								/* Close the file (the block is released if it has not been moved) */
+FRESULT f_replace (FIL* fp, const TCHAR* path);						/* Open a file to write new content in place of the old one */
+FRESULT f_commit (FIL* fp);											/* Switch the file to the new content and close it */
 FRESULT f_mount (FATFS* fs, const TCHAR* path, BYTE opt);			/* Mount/Unmount a logical drive */
 FRESULT f_mkfs (const TCHAR* path, BYTE opt, DWORD au, void* work, UINT len);	/* Create a FAT volume */
 FRESULT f_fdisk (BYTE pdrv, const DWORD* szt, void* work);			/* Divide a physical drive into some partitions */
@@ -322,6 +457,8 @@ TCHAR* f_gets (TCHAR* buff, int len, FIL* fp);						/* Get a string from the fil
 #define f_rewind(fp) f_lseek((fp), 0)
 #define f_rewinddir(dp) f_readdir((dp), 0)
 #define f_rmdir(path) f_unlink(path)
+#define f_chkdone(cp) ((int)((cp)->phase == 0))
+#define f_defragdone(dp) ((int)((dp)->phase == 0))
 #define f_unmount(path) f_mount(0, path, 0)
 
 #ifndef EOF
@@ -350,6 +487,11 @@ void* ff_memalloc (UINT msize);			/* Allocate memory block */
 void ff_memfree (void* mblock);			/* Free memory block */
 #endif
 
+/* Millisecond clock for the sync policy (defined in ftime.c) */
+#if FF_SYNC_POLICY && !FF_FS_READONLY
+DWORD ff_get_ms (void);
+#endif
+
 /* Sync functions */
 #if FF_FS_REENTRANT
 int ff_cre_syncobj (BYTE vol, FF_SYNC_t* sobj);	/* Create a sync object */
@@ -374,6 +516,12 @@ int ff_del_syncobj (FF_SYNC_t sobj);	/* Delete a sync object */
 #define	FA_OPEN_ALWAYS		0x10
 #define	FA_OPEN_APPEND		0x30
 
+/* Sync policies (2nd argument of f_setsync) */
+#define FSY_ALWAYS	0	/* f_sync updates the directory entry every time */
+#define FSY_TIME	1	/* f_sync updates it when arg ms have elapsed since the last update */
+#define FSY_SIZE	2	/* f_sync updates it when arg bytes have been written since the last update */
+#define FSY_FLUSH	3	/* Only f_flush and f_close update it */
+
 /* Fast seek controls (2nd argument of f_lseek) */
 #define CREATE_LINKMAP	((FSIZE_t)0 - 1)
 
@@ -37,24 +37,84 @@
 #endif
 
 #ifndef FF_USE_FIND
-#define FF_USE_FIND		0
+#define FF_USE_FIND		1
 /* This option switches filtered directory read functions, f_findfirst() and
 /  f_findnext(). (0:Disable, 1:Enable 2:Enable with matching altname[] too) */
 #endif
 
+#ifndef FF_FIND_PAT
+#define FF_FIND_PAT		24
+/* This option defines the max number of characters of a matching pattern that
+/  f_findfirst() compiles into the DIR object (2 bytes each). Longer patterns are
+/  parsed by pattern_matching() for each directory item. 1-254 */
+#endif
+
+#ifndef FF_USE_READDIRV
+#define FF_USE_READDIRV	1
+/* This option switches f_readdirv() function that reads directory items in batches
+/  into an array of compact DIRENT items and a buffer of their names.
+/  (0:Disable or 1:Enable) Also FF_FS_MINIMIZE needs to be 0 or 1 to enable this option. */
+#endif
+
 #ifndef FF_USE_MKFS
 #define FF_USE_MKFS		0
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 #endif
 
 #ifndef FF_USE_FASTSEEK
-#define FF_USE_FASTSEEK	0
-/* This option switches fast seek function. (0:Disable or 1:Enable) */
+#define FF_USE_FASTSEEK	1
+/* This option switches fast seek function. (0:Disable or 1:Enable)
+/  See ffseek.h for the helper that manages link map tables in an arena. */
 #endif
 
 #ifndef FF_USE_EXPAND
-#define FF_USE_EXPAND	0
-/* This option switches f_expand function. (0:Disable or 1:Enable) */
+#define FF_USE_EXPAND	1
+/* This option switches f_expand function. (0:Disable or 1:Enable)
+/  Unlike the original f_expand, this version can also append a contiguous block
+/  to a file that is not empty. See fflog.h that uses it to preallocate logs. */
+#endif
+
+#ifndef FF_USE_CHKVOL
+#define FF_USE_CHKVOL	1
+/* This option switches the incremental volume check functions, f_chkvol() and
+/  f_chknext(), which recount free clusters and look for lost cluster chains in
+/  time slices of a given number of sectors. (0:Disable or 1:Enable)
+/  Also FF_FS_READONLY needs to be 0 to enable this option. */
+#endif
+
+#ifndef FF_CHK_DEPTH
+#define FF_CHK_DEPTH	8
+/* This option defines the max depth of sub-directories that f_chknext() walks
+/  when it looks for lost cluster chains (8 bytes per level in the FCHK object).
+/  The lost chains are not counted on a volume with deeper directories. */
+#endif
+
+#ifndef FF_USE_DEFRAG
+#define FF_USE_DEFRAG	1
+/* This option switches the fragmentation functions: f_getfrag() and f_getfragvol()
+/  count the fragments of a file or of all cluster chains on the volume, and
+/  f_defragopen(), f_defragnext() and f_defragclose() move a fragmented file into
+/  a contiguous block a given number of clusters at a time. (0:Disable or 1:Enable)
+/  Also FF_FS_READONLY needs to be 0 to enable the defragmentation. */
+#endif
+
+#ifndef FF_USE_REPLACE
+#define FF_USE_REPLACE	1
+/* This option switches the atomic replacement of file content: f_replace() opens
+/  a file and starts its new content on a new cluster chain while the directory entry
+/  keeps pointing to the old one, f_commit() switches the entry to the new content
+/  and f_close() discards it. (0:Disable or 1:Enable)
+/  Also FF_FS_READONLY needs to be 0 to enable this option. */
+#endif
+
+#ifndef FF_USE_DISKIOV
+#define FF_USE_DISKIOV	1
+/* This option switches use of the scatter/gather disk functions, disk_readv() and
+/  disk_writev(), which transfer consecutive sectors from/to several buffers in one
+/  request. f_read() and f_write() use them to read a partial last sector into the
+/  file buffer and to write back the file buffer along with the following sectors
+/  written directly from the caller's buffer. (0:Disable or 1:Enable)
+/  The disk I/O driver has to implement both functions when this option is 1. */
 #endif
 
 #ifndef FF_USE_CHMOD
@@ -70,7 +130,7 @@
 #endif
 
 #ifndef FF_USE_FORWARD
-#define FF_USE_FORWARD	0
+#define FF_USE_FORWARD	1
 /* This option switches f_forward() function. (0:Disable or 1:Enable) */
 #endif
 
@@ -79,7 +139,7 @@
 /---------------------------------------------------------------------------*/
 
 #ifndef FF_CODE_PAGE
-#define FF_CODE_PAGE	932
+#define FF_CODE_PAGE	20127
 /* This option specifies the OEM code page to be used on the target system.
 /  Incorrect code page setting can cause a file open failure.
 /
@@ -104,12 +164,17 @@
 /   936 - Simplified Chinese (DBCS)
 /   949 - Korean (DBCS)
 /   950 - Traditional Chinese (DBCS)
+/ 20127 - ASCII only (no conversion tables, non-ASCII characters are rejected)
 /     0 - Include all code pages above and configured by f_setcp()
-*/
+/
+/  Only the conversion tables of the selected code page are compiled in. On the
+/  ESP8266 they are kept in the flash and read by aligned 32-bit words. The DBCS
+/  code pages need the largest tables (60KB for 932, 175KB for 936), SBCS code
+/  pages about 1.4KB with the Unicode up-case table and ASCII almost nothing. */
 #endif
 
 #ifndef FF_USE_LFN
-#define FF_USE_LFN		0
+#define FF_USE_LFN		3
 #endif
 #ifndef FF_MAX_LFN
 #define FF_MAX_LFN		255
@@ -131,6 +196,19 @@
 /  ff_memfree() in ffsystem.c, need to be added to the project. */
 #endif
 
+#ifndef FF_LFN_ARENA
+#define FF_LFN_ARENA	1
+/* This option sets the number of blocks in the fixed-size arena that ff_memalloc()
+/  in ffsystem.c allocates the LFN working buffers from when FF_USE_LFN == 3.
+/  Each block occupies the size of the LFN working buffer (see above) and is
+/  reused without a call to malloc(). A request that does not fit a block or
+/  comes when all blocks are in use fails, which makes the file function return
+/  FR_NOT_ENOUGH_CORE, so at thread-safe configuration it should be set to the
+/  number of tasks that can access different volumes at the same time. Optional
+/  buffers that FatFs requests for f_mkdir() and f_mkfs() are taken from the
+/  arena only when a block is free. */
+#endif
+
 #ifndef FF_LFN_UNICODE
 #define FF_LFN_UNICODE	0
 /* This option switches the character encoding on the API when LFN is enabled.
@@ -248,6 +326,86 @@
 */
 #endif
 
+#ifndef FF_WIN_CACHE
+#define FF_WIN_CACHE	4
+/* This option defines number of sector buffers in the disk access window of each
+/  volume. The window holds FAT, directory and other metadata sectors. With more than
+/  one buffer the sectors moved out of the window stay cached, so switching between
+/  e.g. a FAT sector and a directory sector does not write back and reload the window
+/  each time. Dirty buffers are written back when they are evicted and when the
+/  filesystem is synced. Each buffer above 1 adds FF_MAX_SS bytes to the FATFS object.
+/  1 keeps the single window of the original. The cache is not used when FF_FS_TINY
+/  is 1 as the window is then shared with file data. With FF_USE_DISKIOV, reading a
+/  directory in sequence (f_readdir, f_readdirv) loads the following sectors of the
+/  directory cluster into the clean cache buffers along with the one it needs. */
+#endif
+
+#ifndef FF_DIR_INDEX
+#define FF_DIR_INDEX	0
+/* This option defines number of slots in the directory index each volume keeps in
+/  RAM. It must be a power of 2. The index maps hashes of file names to locations of
+/  their entries in the large (more than 64 entries) FAT12/16/32 directory that was
+/  searched last, so that opening a file in a directory with thousands of entries does
+/  not read the directory from its top. The index is built on the first search that
+/  goes through a large directory and updated as files are created and removed there.
+/  Each slot takes 4 bytes. A name that has LFN takes 2 slots and no more than 3/4 of
+/  the slots are used. 0 disables the index. */
+#endif
+
+#ifndef FF_FAT_MAP_SIZE
+#define FF_FAT_MAP_SIZE	256
+/* This option defines size (in bytes) of the free cluster map each volume keeps
+/  in RAM to speed up search for free clusters on FAT12/16/32 volumes. Clusters are
+/  split into as many equal groups as the map has bits. A bit is set when its group
+/  is found to have no free cluster and cleared when a cluster in the group is freed.
+/  The map is built as free clusters are searched and f_getfree() scans the FAT.
+/  0 disables the map. It has no effect at read-only configuration. */
+#endif
+
+#ifndef FF_SYNC_POLICY
+#define FF_SYNC_POLICY	1
+/* This option switches the sync policy of file objects. (0:Disable or 1:Enable)
+/  When enabled, f_setsync() lets f_sync() of a file defer the update of its directory
+/  entry (and the FSINFO) until some time has elapsed or some data have been written
+/  since the last update, or until f_flush() or f_close() is called. The deferred
+/  f_sync() still writes back the file data and the FAT. The millisecond clock the
+/  policy needs, ff_get_ms(), is provided by ftime.c. */
+#endif
+
+#ifndef FF_FILE_EXTENTS
+#define FF_FILE_EXTENTS	4
+/* This option defines number of entries in the extent cache of each file object.
+/  An entry maps a run of contiguous clusters of the file (extent) and is filled as
+/  f_read(), f_write() and f_lseek() follow the cluster chain, so reading through an
+/  extent and seeking back into it need no FAT access. Each entry takes 12 bytes of
+/  the file object. The cache is consulted after the cluster link map table when the
+/  fast seek is active. 0 disables the cache. */
+#endif
+
+#ifndef FF_BUF_POOL
+#define FF_BUF_POOL	0
+/* This option defines number of sector buffers in the file buffer pool of each
+/  volume. When it is 0, each file object holds its own FF_MAX_SS bytes sector buffer.
+/  When it is 1 to 255, file objects hold no buffer and the open files of the volume
+/  share the buffers of the pool instead. A file takes a buffer when it transfers a
+/  partial sector and keeps it until it is closed or the buffer is taken by another
+/  file. The least recently used buffer is taken and written back if it is dirty. Whole
+/  sector transfers go directly to the caller's buffer and do not need a buffer. The
+/  pool adds FF_BUF_POOL * FF_MAX_SS bytes to the FATFS object. Every file opened with
+/  the pool must be closed by f_close(). It has no effect when FF_FS_TINY is 1. */
+#endif
+
+#ifndef FF_WRITE_BEHIND
+#define FF_WRITE_BEHIND	1
+/* This option switches the write-behind buffer of file objects. (0:Disable or 1:Enable)
+/  When enabled, f_setwbuf() gives a file a buffer of several sectors (up to a cluster
+/  is sensible) in which f_write() collects the sectors it has filled in the sector
+/  buffer of the file, instead of writing each of them to the disk by itself. The
+/  collected sectors are written by a single multiple sector write when the buffer
+/  is full, when a sector does not follow them, and before the file is read, seeked,
+/  truncated or synced. It has no effect when FF_FS_TINY is 1. */
+#endif
+
 /*---------------------------------------------------------------------------/
 / System Configurations
 /---------------------------------------------------------------------------*/
@@ -261,7 +419,7 @@
 #endif
 
 #ifndef FF_FS_EXFAT
-#define FF_FS_EXFAT		0
+#define FF_FS_EXFAT		1
 /* This option switches support for exFAT filesystem. (0:Disable or 1:Enable)
 /  To enable exFAT, also LFN needs to be enabled. (FF_USE_LFN >= 1)
 /  Note that enabling exFAT discards ANSI C (C89) compatibility. */
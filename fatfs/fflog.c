@@ -0,0 +1,119 @@
+/**
+ * \file  fflog.c
+ * \brief Append-only log files with contiguous preallocation
+ */
+#include "ff.h"
+
+#if FF_USE_EXPAND && !FF_FS_READONLY
+
+#include "fflog.h"
+#include <string.h>
+
+FRESULT fflog_open(fflog_t * log, const TCHAR * path, FSIZE_t extent, BYTE * buf, UINT buf_size)
+{
+    FRESULT res = f_open(&log->file, path, FA_WRITE | FA_OPEN_ALWAYS);
+    if (res == FR_OK) {
+        log->end = f_size(&log->file);
+        log->extent = extent;
+        log->buf = buf;
+        log->buf_size = buf_size;
+        log->len = 0;
+        res = f_lseek(&log->file, log->end);
+        if (res != FR_OK) {
+            f_close(&log->file);
+        }
+    }
+    return res;
+}
+
+/**
+ * \brief Writes buffered data to the file
+ *
+ * Makes sure that there is an extent to write the data into first.
+ * If a contiguous block cannot be found the data are still written
+ * and FatFs allocates clusters as usual.
+ */
+static FRESULT flush(fflog_t * log)
+{
+    if (log->len == 0) {
+        return FR_OK;
+    }
+    FIL * fp = &log->file;
+    FSIZE_t need = log->end + log->len;
+    if (need > f_size(fp)) {
+        FSIZE_t fsz = f_size(fp) + log->extent;
+        f_expand(fp, fsz > need ? fsz : need, 1);
+    }
+    UINT num_written;
+    FRESULT res = f_write(fp, log->buf, log->len, &num_written);
+    if (res == FR_OK && num_written < log->len) {
+        res = FR_DENIED; // disk full
+    }
+    log->end += num_written;
+    log->len -= num_written;
+    if (log->len) {
+        memmove(log->buf, log->buf + num_written, log->len);
+    }
+    return res;
+}
+
+FRESULT fflog_write(fflog_t * log, const void * data, UINT size)
+{
+    const BYTE * src = data;
+    while (size) {
+        // Fill the buffer up to the next buffer size boundary in the file,
+        // so that after the first flush all writes are aligned.
+        UINT room = log->buf_size - (UINT)((log->end + log->len) % log->buf_size);
+        UINT num_bytes = size < room ? size : room;
+        memcpy(log->buf + log->len, src, num_bytes);
+        log->len += num_bytes;
+        src  += num_bytes;
+        size -= num_bytes;
+        if (num_bytes == room) {
+            FRESULT res = flush(log);
+            if (res != FR_OK) {
+                return res;
+            }
+        }
+    }
+    return FR_OK;
+}
+
+FRESULT fflog_sync(fflog_t * log)
+{
+    FRESULT res = flush(log);
+    if (res == FR_OK) {
+        // Record only the logical size in the directory entry.
+        // The preallocated clusters remain in the chain.
+        FIL * fp = &log->file;
+        FSIZE_t allocated = fp->obj.objsize;
+        fp->obj.objsize = log->end;
+        res = f_sync(fp);
+        fp->obj.objsize = allocated;
+    }
+    return res;
+}
+
+FRESULT fflog_close(fflog_t * log)
+{
+    FRESULT res = flush(log);
+    // Release the unused part of the extent even if the flush failed,
+    // otherwise f_close would record the whole extent as the file size.
+    FIL * fp = &log->file;
+    FRESULT trunc_res = f_lseek(fp, log->end);
+    if (trunc_res == FR_OK) {
+        trunc_res = f_truncate(fp);
+    }
+    if (trunc_res != FR_OK) {
+        // The file object is unusable. Record at least the logical size,
+        // the rest of the extent is left allocated past the end of the file.
+        fp->obj.objsize = log->end;
+    }
+    FRESULT close_res = f_close(fp);
+    if (res == FR_OK) {
+        res = trunc_res;
+    }
+    return res != FR_OK ? res : close_res;
+}
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * \file  fflog.h
+ * \brief Append-only log files with contiguous preallocation
+ *
+ * A log file grows by large contiguous extents that are allocated with
+ * `f_expand`. Appends within an extent do not touch the FAT, and the data
+ * are written in whole buffers, so the card receives them as long multiple
+ * block writes. The unused part of the last extent is released when the log
+ * is closed.
+ */
+#ifndef __FFLOG_H
+#define __FFLOG_H
+
+#include "ff.h"
+
+#if !FF_USE_EXPAND
+#error "f_expand is disabled (FF_USE_EXPAND)"
+#endif
+
+/**
+ * \brief Log file descriptor
+ */
+typedef struct {
+    FIL     file;       ///< Log file
+    FSIZE_t end;        ///< Logical end of the log - file offset of the first byte in the buffer
+    FSIZE_t extent;     ///< Number of bytes to preallocate at a time
+    BYTE *  buf;        ///< Write buffer
+    UINT    buf_size;   ///< Size of the write buffer
+    UINT    len;        ///< Number of bytes in the write buffer
+} fflog_t;
+
+/**
+ * \brief Opens (or creates) a log file for appending
+ * \param log       Log descriptor
+ * \param path      File name
+ * \param extent    Number of bytes to preallocate when the log needs more space
+ * \param buf       Write buffer
+ * \param buf_size  Size of the write buffer. Must be a multiple of the sector size.
+ * \return the result of `f_open`
+ */
+FRESULT fflog_open(fflog_t * log, const TCHAR * path, FSIZE_t extent, BYTE * buf, UINT buf_size);
+
+/**
+ * \brief Appends data to the log
+ * \param log   Log descriptor
+ * \param data  Data to append
+ * \param size  Number of bytes to append
+ * \return FR_OK when data were appended (they might still be in the buffer)
+ *         or an error returned by `f_expand`/`f_write`
+ */
+FRESULT fflog_write(fflog_t * log, const void * data, UINT size);
+
+/**
+ * \brief Writes buffered data and updates the file size in the directory
+ * \param log   Log descriptor
+ * \return the result of `f_sync`
+ *
+ * Only the data written so far are accounted for in the directory entry.
+ * Should the power fail before the log is closed, the file will have the
+ * size recorded by the last sync and the rest of the extent will be left
+ * allocated past the end of the file. On FAT volumes the clusters stay in
+ * the file's chain and the next #fflog_open of that file reuses them.
+ *
+ * \note On exFAT a contiguous file has no FAT chain and its clusters are
+ *       bounded by the file size, so after a power failure the rest of the
+ *       extent is allocated on the bitmap but belongs to no file. It is lost
+ *       until the volume is repaired, and as it blocks the file from growing
+ *       contiguously, the next extent is not preallocated: FatFs allocates
+ *       the clusters one by one as the log grows.
+ */
+FRESULT fflog_sync(fflog_t * log);
+
+/**
+ * \brief Writes buffered data, trims the extent and closes the log
+ * \param log   Log descriptor
+ * \return FR_OK or an error returned by one of the underlying operations
+ */
+FRESULT fflog_close(fflog_t * log);
+
+/**
+ * \brief Returns the size of the log
+ */
+static inline FSIZE_t fflog_size(fflog_t * log)
+{
+    return log->end + log->len;
+}
+
+#endif
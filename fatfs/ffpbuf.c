@@ -0,0 +1,98 @@
+/**
+ * \file  ffpbuf.c
+ * \brief Streaming of file data into lwIP pbufs
+ */
+#include "ff.h"
+
+#if FF_USE_FORWARD
+
+#include "ffpbuf.h"
+
+FRESULT ffpbuf_read(FIL * fp, struct pbuf * p, UINT * num_read)
+{
+    FRESULT res = FR_OK;
+    *num_read = 0;
+    for (; p && res == FR_OK; p = p->next) {
+        UINT num_bytes;
+        res = f_read(fp, p->payload, p->len, &num_bytes);
+        *num_read += num_bytes;
+        if (num_bytes < p->len) {
+            break;
+        }
+    }
+    return res;
+}
+
+#if !FF_FS_READONLY
+FRESULT ffpbuf_write(FIL * fp, const struct pbuf * p, UINT * num_written)
+{
+    FRESULT res = FR_OK;
+    *num_written = 0;
+    for (; p && res == FR_OK; p = p->next) {
+        UINT num_bytes;
+        res = f_write(fp, p->payload, p->len, &num_bytes);
+        *num_written += num_bytes;
+        if (num_bytes < p->len) {
+            break;
+        }
+    }
+    return res;
+}
+#endif
+
+/**
+ * \brief State of the transfer made by #ffpbuf_forward
+ */
+static struct {
+    ffpbuf_sink_t   sink;
+    void *          arg;
+    struct pbuf *   p;      ///< pbuf for the next piece of data
+    UINT            lost;   ///< Number of bytes of the piece the sink failed to send
+} fwd;
+
+/**
+ * \brief Streaming function for f_forward
+ *
+ * f_forward asks whether the stream is ready (with 0 bytes) before each piece,
+ * so the pbuf is allocated then. A piece that has been passed to f_forward
+ * cannot be rejected without failing the file object, thus the piece the sink
+ * did not send is accounted for and the transfer stops at the next check.
+ */
+static UINT forward(const BYTE * data, UINT size)
+{
+    if (size == 0) {
+        if (!fwd.p && !fwd.lost) {
+            fwd.p = pbuf_alloc(PBUF_RAW, 0, PBUF_REF);
+        }
+        return fwd.p != NULL;
+    }
+    struct pbuf * p = fwd.p;
+    fwd.p = NULL;
+    p->payload = (void *)data;
+    p->len = p->tot_len = size;
+    if (fwd.sink(fwd.arg, p) != ERR_OK) {
+        fwd.lost = size;
+    }
+    pbuf_free(p);
+    return size;
+}
+
+FRESULT ffpbuf_forward(FIL * fp, UINT size, ffpbuf_sink_t sink, void * arg, UINT * num_sent)
+{
+    fwd.sink = sink;
+    fwd.arg = arg;
+    fwd.lost = 0;
+    FRESULT res = f_forward(fp, forward, size, num_sent);
+    if (fwd.p) {
+        // f_forward failed after the readiness check
+        pbuf_free(fwd.p);
+        fwd.p = NULL;
+    }
+    if (res == FR_OK && fwd.lost) {
+        *num_sent -= fwd.lost;
+        res = f_lseek(fp, f_tell(fp) - fwd.lost);
+    }
+    return res;
+}
+
+#endif
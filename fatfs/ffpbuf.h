@@ -0,0 +1,79 @@
+/**
+ * \file  ffpbuf.h
+ * \brief Streaming of file data into lwIP pbufs
+ *
+ * #ffpbuf_read fills the payloads of an allocated pbuf chain in place. Whole
+ * sectors are read from the disk directly into the payloads, the rest is copied
+ * once from the file's sector buffer - there is no intermediate buffer.
+ * #ffpbuf_write does the same in the other direction for received pbufs.
+ *
+ * #ffpbuf_forward does not copy the data at all. `f_forward` streams them from
+ * the file's sector buffer and each piece is passed to a sink in a PBUF_REF pbuf
+ * that points into that buffer.
+ */
+#ifndef __FFPBUF_H
+#define __FFPBUF_H
+
+#include "ff.h"
+#include <lwip/pbuf.h>
+
+#if !FF_USE_FORWARD
+#error "f_forward is disabled (FF_USE_FORWARD)"
+#endif
+
+/**
+ * \brief Reads file data into a pbuf chain
+ * \param       fp        Open file
+ * \param       p         pbuf chain (usually PBUF_RAM or PBUF_POOL) to fill
+ * \param[out]  num_read  Number of bytes read. Less than `p->tot_len` at the end of the file.
+ * \return the result of `f_read`
+ *
+ * The length of the pbufs in the chain is not changed. Trim the chain with
+ * `pbuf_realloc` if fewer bytes than `p->tot_len` were read.
+ */
+FRESULT ffpbuf_read(FIL * fp, struct pbuf * p, UINT * num_read);
+
+#if !FF_FS_READONLY
+/**
+ * \brief Writes the data of a pbuf chain to a file
+ * \param       fp           Open file
+ * \param       p            pbuf chain with the data
+ * \param[out]  num_written  Number of bytes written. Less than `p->tot_len` when the disk is full.
+ * \return the result of `f_write`
+ */
+FRESULT ffpbuf_write(FIL * fp, const struct pbuf * p, UINT * num_written);
+#endif
+
+/**
+ * \brief Consumer of the pbufs made by #ffpbuf_forward
+ * \param  arg  Argument passed to #ffpbuf_forward
+ * \param  p    PBUF_REF pbuf with a piece of the file data
+ * \return ERR_OK if the data were sent. Any other code stops the transfer.
+ *
+ * The payload of the pbuf points into the sector buffer of the file and is only
+ * valid until the sink returns. The sink must not keep a reference to the pbuf
+ * and has to copy the data that are not sent by the time it returns - like
+ * `tcp_write` with TCP_WRITE_FLAG_COPY does.
+ */
+typedef err_t (*ffpbuf_sink_t)(void * arg, struct pbuf * p);
+
+/**
+ * \brief Forwards file data to a sink without copying them
+ * \param       fp        Open file
+ * \param       size      Number of bytes to forward
+ * \param       sink      Function that sends the data
+ * \param       arg       Argument for the sink
+ * \param[out]  num_sent  Number of bytes accepted by the sink
+ * \return the result of `f_forward`
+ *
+ * The data are passed to the sink in pieces of up to one sector. The transfer
+ * stops early when a pbuf cannot be allocated or the sink fails. The file
+ * pointer is then left after the last byte the sink has accepted.
+ *
+ * \note `f_forward` takes a streaming function without an argument, so the
+ *       state of the transfer is kept in a static variable and only one
+ *       #ffpbuf_forward can be in progress at a time.
+ */
+FRESULT ffpbuf_forward(FIL * fp, UINT size, ffpbuf_sink_t sink, void * arg, UINT * num_sent);
+
+#endif
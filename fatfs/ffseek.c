@@ -0,0 +1,162 @@
+/**
+ * \file  ffseek.c
+ * \brief Managed cluster link map tables for the FatFs fast seek
+ */
+#include "ff.h"
+
+#if FF_USE_FASTSEEK
+
+#include "ffseek.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * \def   FFSEEK_HEADROOM
+ * \brief Number of fragments a table is allowed to gain before it needs to grow
+ */
+#ifndef FFSEEK_HEADROOM
+#define FFSEEK_HEADROOM 4
+#endif
+
+/*
+ * Each table in the arena is preceded by a word with its capacity
+ * as FatFs keeps the number of used items in the first word of the table.
+ */
+
+static inline DWORD * block_of(FIL * fp)
+{
+    return fp->cltbl - 1;
+}
+
+static inline bool is_last(ffseek_arena_t * arena, DWORD * block)
+{
+    return block + 1 + *block == arena->buf + arena->top;
+}
+
+static inline FSIZE_t cluster_size(FIL * fp)
+{
+#if FF_MAX_SS == FF_MIN_SS
+    return (FSIZE_t)fp->obj.fs->csize * FF_MAX_SS;
+#else
+    return (FSIZE_t)fp->obj.fs->csize * fp->obj.fs->ssize;
+#endif
+}
+
+/**
+ * \brief Counts clusters mapped by the table
+ */
+static DWORD mapped_clusters(const DWORD * tbl)
+{
+    DWORD num_clusters = 0;
+    ++tbl;
+    while (*tbl) {
+        num_clusters += *tbl;
+        tbl += 2;
+    }
+    return num_clusters;
+}
+
+/**
+ * \brief Allocates a table that can hold at least `num_items` items
+ * \return pointer to the table or NULL if there is no space left in the arena
+ */
+static DWORD * alloc_table(FIL * fp, ffseek_arena_t * arena, UINT num_items)
+{
+    num_items += FFSEEK_HEADROOM * 2;
+    if (fp->cltbl && is_last(arena, block_of(fp))) {
+        // Grow in place
+        DWORD * block = block_of(fp);
+        UINT start = block - arena->buf;
+        if (start + 1 + num_items > arena->size) {
+            num_items = arena->size - start - 1;
+        }
+        *block = num_items;
+        arena->top = start + 1 + num_items;
+        return block + 1;
+    }
+    if (arena->top + 1 + num_items > arena->size) {
+        if (arena->top + 1 + (num_items - FFSEEK_HEADROOM * 2) > arena->size) {
+            return NULL;
+        }
+        num_items = arena->size - arena->top - 1;
+    }
+    DWORD * block = arena->buf + arena->top;
+    *block = num_items;
+    arena->top += 1 + num_items;
+    return block + 1;
+}
+
+void ffseek_arena_init(ffseek_arena_t * arena, DWORD * buf, UINT size)
+{
+    arena->buf  = buf;
+    arena->size = size;
+    arena->top  = 0;
+}
+
+FRESULT ffseek_map(FIL * fp, ffseek_arena_t * arena)
+{
+    if (!fp->cltbl) {
+        // Start with a table for a file that is not fragmented. The first
+        // pass reports the required size if the table is not large enough.
+        fp->cltbl = alloc_table(fp, arena, 4);
+        if (!fp->cltbl) {
+            return FR_NOT_ENOUGH_CORE;
+        }
+    }
+    for (;;) {
+        fp->cltbl[0] = *block_of(fp);
+        FRESULT res = f_lseek(fp, CREATE_LINKMAP);
+        if (res != FR_NOT_ENOUGH_CORE) {
+            if (res != FR_OK) {
+                ffseek_unmap(fp, arena);
+            }
+            return res;
+        }
+        UINT num_items = fp->cltbl[0];
+        DWORD * tbl = alloc_table(fp, arena, num_items);
+        if (!tbl || *(tbl - 1) < num_items) {
+            ffseek_unmap(fp, arena);
+            return FR_NOT_ENOUGH_CORE;
+        }
+        fp->cltbl = tbl;
+    }
+}
+
+FRESULT ffseek_open(FIL * fp, const TCHAR * path, BYTE mode, ffseek_arena_t * arena)
+{
+    FRESULT res = f_open(fp, path, mode);
+    if (res == FR_OK) {
+        // The file is still usable without the table
+        ffseek_map(fp, arena);
+    }
+    return res;
+}
+
+FRESULT ffseek_lseek(FIL * fp, ffseek_arena_t * arena, FSIZE_t ofs)
+{
+    FSIZE_t end = ofs < f_size(fp) ? ofs : f_size(fp);
+    if (!fp->cltbl || (end > 0 && (end - 1) / cluster_size(fp) >= mapped_clusters(fp->cltbl))) {
+        // Not mapped yet or the file has grown beyond the mapped part of the chain
+        ffseek_map(fp, arena);
+    }
+    return f_lseek(fp, ofs);
+}
+
+void ffseek_unmap(FIL * fp, ffseek_arena_t * arena)
+{
+    if (fp->cltbl) {
+        DWORD * block = block_of(fp);
+        if (is_last(arena, block)) {
+            arena->top = block - arena->buf;
+        }
+        fp->cltbl = NULL;
+    }
+}
+
+FRESULT ffseek_close(FIL * fp, ffseek_arena_t * arena)
+{
+    ffseek_unmap(fp, arena);
+    return f_close(fp);
+}
+
+#endif
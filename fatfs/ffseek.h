@@ -0,0 +1,102 @@
+/**
+ * \file  ffseek.h
+ * \brief Managed cluster link map tables for the FatFs fast seek
+ *
+ * FatFs fast seek mode needs a cluster link map table (CLMT) that the
+ * application has to size and allocate for each file. Functions here carve
+ * the tables out of an arena provided by the program, size them to fit the
+ * file's cluster chain and grow them when the file grows.
+ */
+#ifndef __FFSEEK_H
+#define __FFSEEK_H
+
+#include "ff.h"
+
+#if !FF_USE_FASTSEEK
+#error "Fast seek is disabled (FF_USE_FASTSEEK)"
+#endif
+
+/**
+ * \brief Arena for the link map tables
+ *
+ * Tables are allocated from the arena top. A table that needs to grow
+ * is extended in place if it is the last one in the arena. Otherwise it is
+ * moved to the top and the space it occupied is not reclaimed until the
+ * arena is reset.
+ */
+typedef struct {
+    DWORD * buf;    ///< Memory for the tables
+    UINT    size;   ///< Size of the arena in DWORDs
+    UINT    top;    ///< Number of DWORDs allocated
+} ffseek_arena_t;
+
+/**
+ * \brief Initializes (or resets) the arena
+ * \param arena  Arena descriptor
+ * \param buf    Memory that will be used for the tables
+ * \param size   Size of the memory in DWORDs
+ *
+ * \note Resetting an arena invalidates tables of all files that still use it.
+ */
+void ffseek_arena_init(ffseek_arena_t * arena, DWORD * buf, UINT size);
+
+/**
+ * \brief Opens a file for random access
+ * \param fp     File object
+ * \param path   File name
+ * \param mode   Access mode and open method flags (see `f_open`)
+ * \param arena  Arena where the link map table of the file will be allocated
+ * \return the result of `f_open`
+ *
+ * The file is opened in fast seek mode if its link map table fits into the
+ * arena. Otherwise it is left in the normal mode and #ffseek_lseek will
+ * try to map it again later.
+ */
+FRESULT ffseek_open(FIL * fp, const TCHAR * path, BYTE mode, ffseek_arena_t * arena);
+
+/**
+ * \brief Builds (or rebuilds) the link map table of an open file
+ * \param fp     File object
+ * \param arena  Arena where the link map table is allocated
+ * \return FR_OK               if the file is in fast seek mode
+ *         FR_NOT_ENOUGH_CORE  if the table does not fit into the arena
+ *                             (the file is left in the normal mode)
+ *         any other error that `f_lseek` might return
+ */
+FRESULT ffseek_map(FIL * fp, ffseek_arena_t * arena);
+
+/**
+ * \brief Moves file read/write pointer
+ * \param fp     File object
+ * \param arena  Arena where the link map table of the file is allocated
+ * \param ofs    New file pointer from the top of the file
+ * \return the result of `f_lseek`
+ *
+ * Grows the table first if the file has grown beyond the part of the chain
+ * that the table maps. When the table cannot grow the seek is performed by
+ * following the FAT chain.
+ *
+ * \note In fast seek mode a file cannot be expanded with `f_lseek`. Also
+ *       `f_truncate` makes the table stale. Call #ffseek_map after it.
+ */
+FRESULT ffseek_lseek(FIL * fp, ffseek_arena_t * arena, FSIZE_t ofs);
+
+/**
+ * \brief Switches the file back to the normal mode and releases its table
+ * \param fp     File object
+ * \param arena  Arena where the link map table of the file is allocated
+ *
+ * The space is returned to the arena only if the table is the last one
+ * allocated.
+ */
+void ffseek_unmap(FIL * fp, ffseek_arena_t * arena);
+
+/**
+ * \brief Closes the file opened by #ffseek_open
+ * \param fp     File object
+ * \param arena  Arena where the link map table of the file is allocated
+ * \return the result of `f_close`
+ */
+FRESULT ffseek_close(FIL * fp, ffseek_arena_t * arena);
+
+#endif
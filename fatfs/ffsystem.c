@@ -9,6 +9,34 @@
 
 #if FF_USE_LFN == 3	/* Dynamic memory allocation */
 
+/* The working buffers are taken from a static arena of FF_LFN_ARENA blocks
+/  instead of the heap. Each file function allocates one buffer on entry and
+/  frees it on exit, so a few blocks serve all tasks and the heap is never
+/  fragmented by them. */
+
+#if FF_FS_EXFAT
+#define ARENA_BLOCK	((FF_MAX_LFN + 1) * 2 + (FF_MAX_LFN + 44U) / 15 * 32)	/* LFN working buffer and directory entry block */
+#else
+#define ARENA_BLOCK	((FF_MAX_LFN + 1) * 2)	/* LFN working buffer */
+#endif
+
+#if FF_FS_REENTRANT
+#include <FreeRTOS.h>
+#include <task.h>
+#define ARENA_LOCK()	taskENTER_CRITICAL()
+#define ARENA_UNLOCK()	taskEXIT_CRITICAL()
+#define ARENA_TASK()	((void*)xTaskGetCurrentTaskHandle())
+#else
+#define ARENA_LOCK()
+#define ARENA_UNLOCK()
+#define ARENA_TASK()	((void*)0)
+#endif
+
+static DWORD ArenaMem[FF_LFN_ARENA][(ARENA_BLOCK + 3) / 4];	/* Arena blocks */
+static BYTE ArenaUsed[FF_LFN_ARENA];	/* Block is allocated */
+static void* ArenaTask[FF_LFN_ARENA];	/* Task that allocated the block last */
+
+
 /*------------------------------------------------------------------------*/
 /* Allocate a memory block                                                */
 /*------------------------------------------------------------------------*/
@@ -17,7 +45,25 @@ void* ff_memalloc (	/* Returns pointer to the allocated memory block (null if no
 	UINT msize		/* Number of bytes to allocate */
 )
 {
-	return malloc(msize);	/* Allocate a new memory block with POSIX API */
+	UINT i, n = FF_LFN_ARENA;
+	void* task = ARENA_TASK();
+
+
+	if (msize > sizeof ArenaMem[0]) return 0;	/* Does not fit a block */
+	ARENA_LOCK();
+	for (i = 0; i < FF_LFN_ARENA; i++) {
+		if (!ArenaUsed[i]) {
+			if (ArenaTask[i] == task) {	/* Reuse the block this task had last */
+				n = i; break;
+			}
+			if (n == FF_LFN_ARENA) n = i;	/* Otherwise the first free one */
+		}
+	}
+	if (n < FF_LFN_ARENA) {
+		ArenaUsed[n] = 1; ArenaTask[n] = task;
+	}
+	ARENA_UNLOCK();
+	return n < FF_LFN_ARENA ? ArenaMem[n] : 0;
 }
 
 
@@ -29,7 +75,15 @@ void ff_memfree (
 	void* mblock	/* Pointer to the memory block to free (nothing to do if null) */
 )
 {
-	free(mblock);	/* Free the memory block with POSIX API */
+	UINT i;
+
+
+	for (i = 0; i < FF_LFN_ARENA; i++) {
+		if (mblock == ArenaMem[i]) {
+			ArenaUsed[i] = 0;
+			break;
+		}
+	}
 }
 
 #endif
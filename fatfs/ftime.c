@@ -1,6 +1,8 @@
 #include "ff.h"
 #include <sys/time.h>
 #include <time.h>
+#include <FreeRTOS.h>
+#include <task.h>
 
 /**
  * \brief Get the current time
@@ -33,4 +35,14 @@ DWORD get_fattime (void)
     fattime.second = tm.tm_sec / 2;
 
     return fattime.packed;
-}
\ No newline at end of file
+}
+
+/**
+ * \brief Get the time elapsed since the system start in milliseconds
+ * \note  FatFs uses it to time the deferred directory entry updates of
+ *        the FSY_TIME sync policy. It wraps around in about 49 days.
+ */
+DWORD ff_get_ms (void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
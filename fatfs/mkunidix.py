@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Generates ffunidix.h - direct index of the DBCS conversion tables
+
+The Unicode <-> DBCS pair tables in ffunicode.c are converted into two-level
+tables that are indexed by the character code:
+
+    dix[0..1023]    offset of the page of code >> 6 in dix, 0 if the page is empty
+    dix[ofs + 0..63] converted codes for code & 63, 0 if there is no conversion
+
+so a conversion takes two reads instead of a binary search over the pairs.
+
+Usage: python3 mkunidix.py [ffunicode.c [ffunidix.h]]
+"""
+import re
+import sys
+
+CODE_PAGES = (932, 936, 949, 950)
+PAGE_BITS = 6
+
+
+def pair_table(src, name):
+    m = re.search(r'static const WCHAR ' + name + r'\[\][^=]*=\s*\{(.*?)\};', src, re.S)
+    values = [int(v, 16) for v in re.findall(r'0x[0-9A-Fa-f]+', m.group(1))]
+    return values[0::2], values[1::2]
+
+
+def search(keys, values, key):
+    """Emulates the former binary search to pick the same pair for duplicate keys"""
+    li, hi = 0, len(keys) - 1
+    for _ in range(16):
+        i = li + (hi - li) // 2
+        if key == keys[i]:
+            return values[i]
+        if key > keys[i]:
+            li = i
+        else:
+            hi = i
+    return None
+
+
+def direct_index(keys, values):
+    conv = {}
+    for key, value in zip(keys, values):
+        if key not in conv:
+            conv[key] = search(keys, values, key) or value
+    size = 1 << PAGE_BITS
+    dix = [0] * (0x10000 >> PAGE_BITS)
+    for pg in sorted(set(key >> PAGE_BITS for key in conv)):
+        dix[pg] = len(dix)
+        dix += [conv.get(pg << PAGE_BITS | i, 0) for i in range(size)]
+    if len(dix) > 0x10000:
+        raise ValueError('index is too large')
+    return dix
+
+
+def c_array(name, values):
+    lines = ['static const WCHAR %s[] TBL_ATTR = {' % name]
+    for i in range(0, len(values), 16):
+        lines.append('\t' + ','.join('0x%04X' % v for v in values[i:i + 16]) + ',')
+    lines.append('};')
+    return '\n'.join(lines)
+
+
+def main():
+    src_name = sys.argv[1] if len(sys.argv) > 1 else 'ffunicode.c'
+    out_name = sys.argv[2] if len(sys.argv) > 2 else 'ffunidix.h'
+    with open(src_name, encoding='latin-1') as f:
+        src = f.read().replace('\r\n', '\n')
+    out = [
+        '/*------------------------------------------------------------------------*/',
+        '/* Direct index DBCS conversion tables                                    */',
+        '/* Generated from the pair tables in ffunicode.c by mkunidix.py           */',
+        '/*------------------------------------------------------------------------*/',
+        '',
+        '#define DIX_BITS\t%d\t/* Page size (log2) */' % PAGE_BITS,
+        '',
+    ]
+    for cp in CODE_PAGES:
+        out.append('#if FF_CODE_PAGE == %d || FF_CODE_PAGE == 0' % cp)
+        for tbl in ('uni2oem', 'oem2uni'):
+            out.append(c_array('dix_%s%d' % (tbl, cp), direct_index(*pair_table(src, '%s%d' % (tbl, cp)))))
+        out.append('#endif')
+        out.append('')
+    with open(out_name, 'w', newline='\r\n') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
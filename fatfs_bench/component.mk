@@ -0,0 +1,3 @@
+fatfs_bench_SRC_DIR = $(fatfs_bench_ROOT)
+INC_DIRS += $(fatfs_bench_ROOT)
+$(eval $(call component_compile_rules,fatfs_bench))
@@ -0,0 +1,482 @@
+/**
+ * \file  ffbench.c
+ * \brief FatFs benchmark suite
+ */
+#include "ffbench.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef __linux__
+#include <time.h>
+#else
+#include <esplibs/libmain.h>
+#endif
+
+#if !FF_FS_READONLY && FF_FS_MINIMIZE == 0
+
+#define RANDOM_IO_SIZE  4096
+#define LOG_RECORD_SIZE 40
+#define MAX_PATH        128
+
+/**
+ * \brief State of the running benchmark
+ */
+typedef struct {
+    BYTE                pdrv;       ///< Drive the counters are read from
+    ffbench_report_t    report;     ///< Result receiver
+    ffbench_result_t    result;     ///< Result of the benchmark
+    DWORD               start;      ///< Timestamp of the benchmark start
+    DWORD               seed;       ///< Random offset/order generator state
+} bench_t;
+
+/**
+ * \brief Returns current time in microseconds
+ */
+static DWORD now_us(void)
+{
+#ifdef __linux__
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (DWORD)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+    return sdk_system_relative_time(0);
+#endif
+}
+
+/**
+ * \brief Returns the next pseudo-random number
+ */
+static DWORD next_random(bench_t * b)
+{
+    b->seed = b->seed * 1103515245 + 12345;
+    return b->seed >> 8;
+}
+
+static void begin(bench_t * b, const char * name)
+{
+    b->result.name = name;
+    b->result.ops = 0;
+    disk_ioctl(b->pdrv, CTRL_GET_STATS, &b->result.io);
+    b->start = now_us();
+}
+
+static void end(bench_t * b)
+{
+    DSTATS io;
+    b->result.us = now_us() - b->start;
+    disk_ioctl(b->pdrv, CTRL_GET_STATS, &io);
+    b->result.io.n_read   = io.n_read   - b->result.io.n_read;
+    b->result.io.n_write  = io.n_write  - b->result.io.n_write;
+    b->result.io.sc_read  = io.sc_read  - b->result.io.sc_read;
+    b->result.io.sc_write = io.sc_write - b->result.io.sc_write;
+    b->report(&b->result);
+}
+
+/**
+ * \brief Writes and then reads the test file sequentially
+ */
+static FRESULT sequential(bench_t * b, const ffbench_config_t * cfg, const TCHAR * path, BYTE * buf)
+{
+    FIL file;
+    UINT num_bytes;
+    FRESULT res;
+
+    for (UINT i = 0; i < cfg->chunk; i++) {
+        buf[i] = (BYTE)i;
+    }
+    begin(b, "seq write");
+    res = f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res != FR_OK) {
+        return res;
+    }
+    for (FSIZE_t left = cfg->file_size; res == FR_OK && left; left -= num_bytes) {
+        UINT len = left < cfg->chunk ? (UINT)left : cfg->chunk;
+        res = f_write(&file, buf, len, &num_bytes);
+        if (res == FR_OK && num_bytes < len) {
+            res = FR_DENIED; // disk full
+        }
+        b->result.ops++;
+    }
+    FRESULT err = f_close(&file);
+    if (res == FR_OK) {
+        res = err;
+    }
+    if (res != FR_OK) {
+        return res;
+    }
+    end(b);
+
+    begin(b, "seq read");
+    res = f_open(&file, path, FA_READ);
+    if (res != FR_OK) {
+        return res;
+    }
+    while (res == FR_OK) {
+        res = f_read(&file, buf, cfg->chunk, &num_bytes);
+        if (num_bytes == 0) break;
+        b->result.ops++;
+    }
+    f_close(&file);
+    if (res != FR_OK) {
+        return res;
+    }
+    end(b);
+    return FR_OK;
+}
+
+/**
+ * \brief Reads and writes 4K blocks at random offsets of the test file
+ */
+static FRESULT random_io(bench_t * b, const ffbench_config_t * cfg, const TCHAR * path, BYTE * buf)
+{
+    static const char * const names[] = { "rand 4K read", "rand 4K write" };
+    DWORD num_blocks = (DWORD)(cfg->file_size / RANDOM_IO_SIZE);
+    FIL file;
+    UINT num_bytes;
+
+    if (num_blocks == 0) {
+        return FR_OK;
+    }
+    FRESULT res = f_open(&file, path, FA_READ | FA_WRITE);
+    if (res != FR_OK) {
+        return res;
+    }
+    for (int is_write = 0; res == FR_OK && is_write < 2; is_write++) {
+        begin(b, names[is_write]);
+        for (UINT i = 0; res == FR_OK && i < cfg->random_ops; i++) {
+            res = f_lseek(&file, (FSIZE_t)(next_random(b) % num_blocks) * RANDOM_IO_SIZE);
+            if (res == FR_OK) {
+                res = is_write ? f_write(&file, buf, RANDOM_IO_SIZE, &num_bytes)
+                               : f_read(&file, buf, RANDOM_IO_SIZE, &num_bytes);
+            }
+            b->result.ops++;
+        }
+        if (res == FR_OK) {
+            end(b);
+        }
+    }
+    f_close(&file);
+    return res;
+}
+
+#if FF_WRITE_BEHIND
+/**
+ * \brief Checks that the write-behind buffer does not bring back overwritten data
+ *
+ * The sector buffer of the file is left dirty with a sector that follows the file
+ * pointer, so the next write collects it and then writes the same sector again.
+ * The first half of the data buffer serves as the write-behind buffer, the other
+ * half holds the data.
+ * \return FR_INT_ERR if the file does not contain the data written last
+ */
+static FRESULT check_write_behind(const TCHAR * path, BYTE * buf)
+{
+    BYTE * data = buf + RANDOM_IO_SIZE / 2;
+    FIL file;
+    UINT num_bytes;
+
+    FRESULT res = f_open(&file, path, FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+    if (res != FR_OK) {
+        return res;
+    }
+    res = f_setwbuf(&file, buf, RANDOM_IO_SIZE / 2);
+    if (res == FR_OK) {
+        memset(data, 'a', 1100);
+        res = f_write(&file, data, 1100, &num_bytes);
+    }
+    if (res == FR_OK) {
+        res = f_lseek(&file, 512);
+    }
+    if (res == FR_OK) {
+        memset(data, 'b', 1536);
+        res = f_write(&file, data, 1536, &num_bytes);
+    }
+    FRESULT err = f_close(&file);
+    if (res == FR_OK) {
+        res = err;
+    }
+    if (res == FR_OK) {
+        res = f_open(&file, path, FA_READ);
+        if (res == FR_OK) {
+            res = f_read(&file, data, 2048, &num_bytes);
+            f_close(&file);
+        }
+    }
+    for (UINT i = 0; res == FR_OK && i < 2048; i++) {
+        if (num_bytes != 2048 || data[i] != (i < 512 ? 'a' : 'b')) {
+            res = FR_INT_ERR;
+        }
+    }
+    return res;
+}
+#endif
+
+/**
+ * \brief Appends small records to a file like a logger does
+ *
+ * The data buffer serves as the write-behind buffer of the file.
+ */
+static FRESULT log_write(bench_t * b, const ffbench_config_t * cfg, const TCHAR * path, BYTE * buf)
+{
+    BYTE record[LOG_RECORD_SIZE];
+    FIL file;
+    UINT num_bytes;
+
+    memset(record, 'x', sizeof(record));
+    record[LOG_RECORD_SIZE - 1] = '\n';
+    begin(b, "log write");
+    FRESULT res = f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res != FR_OK) {
+        return res;
+    }
+#if FF_WRITE_BEHIND
+    res = f_setwbuf(&file, buf, RANDOM_IO_SIZE);
+#else
+    (void)buf;
+#endif
+    for (FSIZE_t left = cfg->file_size / 8; res == FR_OK && left >= LOG_RECORD_SIZE; left -= LOG_RECORD_SIZE) {
+        res = f_write(&file, record, LOG_RECORD_SIZE, &num_bytes);
+        if (res == FR_OK && num_bytes < LOG_RECORD_SIZE) {
+            res = FR_DENIED; // disk full
+        }
+        b->result.ops++;
+    }
+    FRESULT err = f_close(&file);
+    if (res == FR_OK) {
+        res = err;
+    }
+    if (res != FR_OK) {
+        return res;
+    }
+    end(b);
+#if FF_WRITE_BEHIND
+    res = check_write_behind(path, buf);
+    if (res != FR_OK) {
+        return res;
+    }
+#endif
+    return f_unlink(path);
+}
+
+/**
+ * \brief Creates, writes, closes and deletes small files one after another
+ */
+static FRESULT storm(bench_t * b, const ffbench_config_t * cfg, BYTE * buf)
+{
+    TCHAR path[MAX_PATH];
+    FIL file;
+    UINT num_bytes;
+    FRESULT res = FR_OK;
+
+    begin(b, "create/delete");
+    for (UINT i = 0; res == FR_OK && i < cfg->storm_files; i++) {
+        snprintf(path, sizeof(path), "%s/storm%u.tmp", cfg->dir, i);
+        res = f_open(&file, path, FA_WRITE | FA_CREATE_NEW);
+        if (res == FR_OK) {
+            res = f_write(&file, buf, 100, &num_bytes);
+            FRESULT err = f_close(&file);
+            if (res == FR_OK) {
+                res = err;
+            }
+        }
+        if (res == FR_OK) {
+            res = f_unlink(path);
+        }
+        b->result.ops++;
+    }
+    if (res == FR_OK) {
+        end(b);
+    }
+    return res;
+}
+
+/**
+ * \brief Makes the path of a file in the large directory
+ */
+static void dir_file_path(TCHAR * path, const ffbench_config_t * cfg, UINT i)
+{
+    snprintf(path, MAX_PATH, cfg->short_names ? "%s/dir/F%05u.DAT" : "%s/dir/file_with_long_name_%05u.dat", cfg->dir, i);
+}
+
+#if FF_USE_READDIRV
+#define LIST_BATCH      8
+
+/**
+ * \brief Lists the directory by f_readdirv, names are stored in the buffer
+ */
+static FRESULT list_batch(bench_t * b, const TCHAR * path, BYTE * buf, UINT buf_size)
+{
+    DIRENT ent[LIST_BATCH];
+    DIR dir;
+    UINT num_read;
+    FRESULT res = f_opendir(&dir, path);
+    if (res == FR_OK) {
+        while ((res = f_readdirv(&dir, ent, LIST_BATCH, (TCHAR *)buf, buf_size / sizeof(TCHAR), &num_read)) == FR_OK && num_read) {
+            b->result.ops += num_read;
+        }
+        f_closedir(&dir);
+    }
+    return res;
+}
+#endif
+
+#if FF_USE_FIND
+#define FIND_PASSES     10
+
+/**
+ * \brief Searches the directory for the files of a number range by a pattern
+ */
+static FRESULT find_range(bench_t * b, const ffbench_config_t * cfg, const TCHAR * path, UINT range)
+{
+    TCHAR pattern[32];
+    DIR dir;
+    FILINFO info;
+    snprintf(pattern, sizeof(pattern), cfg->short_names ? "F%04u*.DAT" : "file_with_long_name_%04u*", range);
+    FRESULT res = f_findfirst(&dir, &info, path, pattern);
+    while (res == FR_OK && info.fname[0]) {
+        res = f_findnext(&dir, &info);
+    }
+    f_closedir(&dir);
+    b->result.ops += cfg->dir_files;
+    return res;
+}
+#endif
+
+/**
+ * \brief Fills a directory with files, looks them up, lists, searches and deletes them
+ */
+static FRESULT large_dir(bench_t * b, const ffbench_config_t * cfg, BYTE * buf)
+{
+    TCHAR path[MAX_PATH];
+    FIL file;
+    DIR dir;
+    FILINFO info;
+    FRESULT res;
+
+    snprintf(path, sizeof(path), "%s/dir", cfg->dir);
+    res = f_mkdir(path);
+
+    if (res == FR_OK) {
+        begin(b, "dir create");
+        for (UINT i = 0; res == FR_OK && i < cfg->dir_files; i++) {
+            dir_file_path(path, cfg, i);
+            res = f_open(&file, path, FA_WRITE | FA_CREATE_NEW);
+            if (res == FR_OK) {
+                res = f_close(&file);
+            }
+            b->result.ops++;
+        }
+        if (res == FR_OK) {
+            end(b);
+        }
+    }
+
+    if (res == FR_OK) {
+        begin(b, "dir lookup");
+        for (UINT i = 0; res == FR_OK && i < cfg->dir_files; i++) {
+            dir_file_path(path, cfg, next_random(b) % cfg->dir_files);
+            res = f_stat(path, &info);
+            b->result.ops++;
+        }
+        if (res == FR_OK) {
+            end(b);
+        }
+    }
+
+    if (res == FR_OK) {
+        begin(b, "dir list");
+        snprintf(path, sizeof(path), "%s/dir", cfg->dir);
+        res = f_opendir(&dir, path);
+        if (res == FR_OK) {
+            while ((res = f_readdir(&dir, &info)) == FR_OK && info.fname[0]) {
+                b->result.ops++;
+            }
+            f_closedir(&dir);
+        }
+        if (res == FR_OK) {
+            end(b);
+        }
+    }
+
+#if FF_USE_READDIRV
+    if (res == FR_OK) {
+        // The whole buffer holds names of the items read by a call
+        begin(b, "dir list batch");
+        res = list_batch(b, path, buf, cfg->chunk > RANDOM_IO_SIZE ? cfg->chunk : RANDOM_IO_SIZE);
+        if (res == FR_OK) {
+            end(b);
+        }
+    }
+#endif
+
+#if FF_USE_FIND
+    if (res == FR_OK) {
+        // Each pass goes through the whole directory
+        begin(b, "dir find");
+        for (UINT i = 0; res == FR_OK && i < FIND_PASSES; i++) {
+            res = find_range(b, cfg, path, next_random(b) % (cfg->dir_files / 10 + 1));
+        }
+        if (res == FR_OK) {
+            end(b);
+        }
+    }
+#endif
+
+    if (res == FR_OK) {
+        begin(b, "dir delete");
+        for (UINT i = 0; res == FR_OK && i < cfg->dir_files; i++) {
+            dir_file_path(path, cfg, i);
+            res = f_unlink(path);
+            b->result.ops++;
+        }
+        if (res == FR_OK) {
+            end(b);
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/dir", cfg->dir);
+    FRESULT err = f_unlink(path);
+    return res != FR_OK ? res : err;
+}
+
+FRESULT ffbench_run(BYTE pdrv, const ffbench_config_t * cfg, BYTE * buf, ffbench_report_t report)
+{
+    bench_t b = { .pdrv = pdrv, .report = report, .seed = 1 };
+    TCHAR path[MAX_PATH];
+
+    FRESULT res = f_mkdir(cfg->dir);
+    if (res != FR_OK) {
+        return res;
+    }
+    snprintf(path, sizeof(path), "%s/seq.bin", cfg->dir);
+    res = sequential(&b, cfg, path, buf);
+    if (res == FR_OK) {
+        res = random_io(&b, cfg, path, buf);
+    }
+    FRESULT err = f_unlink(path);
+    if (res == FR_OK && err != FR_NO_FILE) {
+        res = err;
+    }
+    if (res == FR_OK) {
+        snprintf(path, sizeof(path), "%s/log.txt", cfg->dir);
+        res = log_write(&b, cfg, path, buf);
+    }
+    if (res == FR_OK) {
+        res = storm(&b, cfg, buf);
+    }
+    if (res == FR_OK) {
+        res = large_dir(&b, cfg, buf);
+    }
+    err = f_unlink(cfg->dir);
+    return res != FR_OK ? res : err;
+}
+
+void ffbench_print(const ffbench_result_t * result)
+{
+    DWORD us = result->us ? result->us : 1;
+    printf("%-14s %8u ops %10u ops/s %8u reads %8u writes %9u sectors read %9u sectors written\n",
+        result->name, result->ops, (UINT)((unsigned long long)result->ops * 1000000 / us),
+        result->io.n_read, result->io.n_write, result->io.sc_read, result->io.sc_write
+    );
+}
+
+#endif
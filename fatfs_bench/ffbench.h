@@ -0,0 +1,68 @@
+/**
+ * \file  ffbench.h
+ * \brief FatFs benchmark suite
+ *
+ * The suite runs a fixed set of workloads - sequential and random 4K
+ * transfers, a create/delete storm and operations on a large directory -
+ * on a mounted volume and reports how fast each of them was and how many
+ * disk requests it made. It runs on the target and, with the RAM disk or
+ * image file drivers, on a development host, so the effect of a change to
+ * `ffconf.h` can be measured by running it before and after the change.
+ */
+#ifndef __FFBENCH_H
+#define __FFBENCH_H
+
+#include <ff.h>
+#include <diskio.h>
+
+#if FF_USE_LFN && FF_LFN_UNICODE == 1
+#error "UTF-16 API (FF_LFN_UNICODE == 1) is not supported"
+#endif
+
+/**
+ * \brief Benchmark parameters
+ */
+typedef struct {
+    const TCHAR *   dir;            ///< Directory where the test files are created. It must not exist.
+    FSIZE_t         file_size;      ///< Size of the sequential test file
+    UINT            chunk;          ///< Size of the sequential read/write requests
+    UINT            random_ops;     ///< Number of random 4K reads and as many writes
+    UINT            storm_files;    ///< Number of files created and deleted by the storm
+    UINT            dir_files;      ///< Number of files in the large directory
+    BYTE            short_names;    ///< Name the files in the large directory 8.3 instead of long names
+} ffbench_config_t;
+
+/**
+ * \brief Result of a benchmark
+ */
+typedef struct {
+    const char *    name;           ///< Name of the benchmark
+    UINT            ops;            ///< Number of operations performed
+    DWORD           us;             ///< Time taken in microseconds
+    DSTATS          io;             ///< Disk requests made (from CTRL_GET_STATS)
+} ffbench_result_t;
+
+/**
+ * \brief Callback that receives each benchmark result
+ */
+typedef void (*ffbench_report_t)(const ffbench_result_t * result);
+
+/**
+ * \brief  Runs the benchmark suite
+ * \param  pdrv      Physical drive of the volume. Its driver has to support CTRL_GET_STATS.
+ * \param  cfg       Benchmark parameters
+ * \param  buf       Data buffer. It must be at least as large as cfg->chunk and 4KB.
+ * \param  report    Function that is called after each benchmark
+ * \return FR_OK or the error that stopped the suite
+ *
+ * The test files and the directory are removed when the suite completes.
+ */
+FRESULT ffbench_run(BYTE pdrv, const ffbench_config_t * cfg, BYTE * buf, ffbench_report_t report);
+
+/**
+ * \brief  Prints a benchmark result as a table row
+ * \param  result  Benchmark result
+ */
+void ffbench_print(const ffbench_result_t * result);
+
+#endif
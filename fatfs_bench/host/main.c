@@ -0,0 +1,154 @@
+/**
+ * \file  main.c
+ * \brief Runs the FatFs benchmark suite on a development host
+ *
+ * The program is built with one of the host drivers: the RAM disk
+ * (fatfs_ramdisk_io) by default, or the image file driver (fatfs_file_io)
+ * when FFBENCH_FILE_IO is defined.
+ */
+#include <ff.h>
+#include <diskio.h>
+#include "ffbench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef FFBENCH_FILE_IO
+#include <file_io.h>
+#else
+#include <ramdisk_io.h>
+#endif
+
+#if !FF_USE_MKFS
+#error "The benchmark formats the drive. Build it with FF_USE_MKFS=1"
+#endif
+
+DWORD get_fattime(void)
+{
+    time_t now = time(NULL);
+    struct tm * t = localtime(&now);
+    return (DWORD)(t->tm_year - 80) << 25
+         | (DWORD)(t->tm_mon + 1) << 21
+         | (DWORD)t->tm_mday << 16
+         | (DWORD)t->tm_hour << 11
+         | (DWORD)t->tm_min << 5
+         | (DWORD)t->tm_sec >> 1;
+}
+
+#if FF_SYNC_POLICY && !FF_FS_READONLY
+DWORD ff_get_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (DWORD)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+#endif
+
+static void usage(const char * prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -s MB            size of the drive (default 64)\n"
+        "  -t fat|fat32|exfat  filesystem to format the drive with (default fat32)\n"
+        "  -c BYTES         cluster size (default is chosen by f_mkfs)\n"
+        "  -f KB            size of the sequential test file (default 4096)\n"
+        "  -b BYTES         size of the sequential requests (default 4096)\n"
+        "  -r N             number of random 4K reads and writes (default 1000)\n"
+        "  -n N             number of files in the create/delete storm (default 200)\n"
+        "  -d N             number of files in the large directory (default 1000)\n"
+        "  -8               use 8.3 names in the large directory\n"
+#ifdef FFBENCH_FILE_IO
+        "  -i FILE          disk image (default ffbench.img)\n"
+        "  -l R,W,S,Y       read, write, per sector and sync latency in microseconds\n"
+#endif
+        , prog
+    );
+    exit(2);
+}
+
+int main(int argc, char * argv[])
+{
+    static FATFS fs;
+    static BYTE work[FF_MAX_SS];
+    DWORD size_mb = 64, au = 0;
+    BYTE fmt = FM_FAT32;
+    ffbench_config_t cfg = {
+        .dir = "/bench",
+        .file_size = 4096 * 1024,
+        .chunk = 4096,
+        .random_ops = 1000,
+        .storm_files = 200,
+        .dir_files = 1000,
+    };
+#ifdef FFBENCH_FILE_IO
+    const char * image = "ffbench.img";
+    file_io_latency_t latency = { 0 };
+#endif
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:t:c:f:b:r:n:d:8i:l:")) != -1) {
+        switch (opt) {
+            case 's': size_mb = strtoul(optarg, NULL, 0); break;
+            case 't':
+                if (strcmp(optarg, "fat") == 0) fmt = FM_FAT;
+                else if (strcmp(optarg, "fat32") == 0) fmt = FM_FAT32;
+                else if (strcmp(optarg, "exfat") == 0) fmt = FM_EXFAT;
+                else usage(argv[0]);
+                break;
+            case 'c': au = strtoul(optarg, NULL, 0); break;
+            case 'f': cfg.file_size = (FSIZE_t)strtoul(optarg, NULL, 0) * 1024; break;
+            case 'b': cfg.chunk = strtoul(optarg, NULL, 0); break;
+            case 'r': cfg.random_ops = strtoul(optarg, NULL, 0); break;
+            case 'n': cfg.storm_files = strtoul(optarg, NULL, 0); break;
+            case 'd': cfg.dir_files = strtoul(optarg, NULL, 0); break;
+            case '8': cfg.short_names = 1; break;
+#ifdef FFBENCH_FILE_IO
+            case 'i': image = optarg; break;
+            case 'l':
+                if (sscanf(optarg, "%u,%u,%u,%u", &latency.read, &latency.write, &latency.sector, &latency.sync) < 1) {
+                    usage(argv[0]);
+                }
+                break;
+#endif
+            default: usage(argv[0]);
+        }
+    }
+    if (cfg.chunk == 0 || size_mb == 0) {
+        usage(argv[0]);
+    }
+
+    BYTE * buf = malloc(cfg.chunk > 4096 ? cfg.chunk : 4096);
+#ifdef FFBENCH_FILE_IO
+    if (file_io_attach(0, image, size_mb * 2048) < 0) {
+        perror(image);
+        return 1;
+    }
+    file_io_set_latency(0, &latency);
+#else
+    BYTE * mem = calloc(size_mb, 1024 * 1024);
+    if (!buf || !mem) {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+    ramdisk_io_attach(0, mem, size_mb * 2048);
+#endif
+
+    FRESULT res = f_mkfs("", fmt, au, work, sizeof(work));
+    if (res == FR_OK) {
+        res = f_mount(&fs, "", 1);
+    }
+    if (res != FR_OK) {
+        fprintf(stderr, "Cannot format the drive (%d)\n", res);
+        return 1;
+    }
+    printf("%s, %u bytes per cluster\n", fs.fs_type == FS_EXFAT ? "exFAT" : fs.fs_type == FS_FAT32 ? "FAT32" : fs.fs_type == FS_FAT16 ? "FAT16" : "FAT12", fs.csize * 512);
+
+    res = ffbench_run(0, &cfg, buf, ffbench_print);
+    if (res != FR_OK) {
+        fprintf(stderr, "Benchmark failed (%d)\n", res);
+        return 1;
+    }
+    f_unmount("");
+    return 0;
+}
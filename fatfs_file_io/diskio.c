@@ -0,0 +1,311 @@
+/**
+ * \file  diskio.c
+ * \brief FatFs disk I/O driver that accesses disk image files on Linux
+ *
+ * The driver lets FatFs and its configuration be profiled on a development
+ * host. Each request can be delayed to approximate the timing of the real
+ * media.
+ */
+#define _GNU_SOURCE
+#include <ff.h>
+#include <diskio.h>
+#include "file_io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#if (FF_MIN_SS != FF_MAX_SS || FF_MIN_SS != 512)
+#error "Unsupported sector size"
+#endif
+
+/**
+ * \def   FILE_IO_MAX_SEGS
+ * \brief Maximum number of segments of a vector request that are passed
+ *        to the kernel in one call.
+ */
+#ifndef FILE_IO_MAX_SEGS
+#define FILE_IO_MAX_SEGS 16
+#endif
+
+/**
+ * \brief Image file drive
+ */
+typedef struct {
+    int                 fd;             ///< Image file descriptor or -1
+    DWORD               num_sectors;    ///< Size of the drive in sectors
+    file_io_latency_t   latency;        ///< Simulated latency
+} image_t;
+
+static image_t image[FF_VOLUMES] = { [0 ... FF_VOLUMES - 1] = { .fd = -1 } };
+static DSTATUS status[FF_VOLUMES] = { [0 ... FF_VOLUMES - 1] = STA_NOINIT };
+static DSTATS stats[FF_VOLUMES];    ///< Number of read/write requests made by FatFs
+
+int file_io_attach(BYTE pdrv, const char * path, DWORD num_sectors)
+{
+    if (pdrv >= FF_VOLUMES) {
+        errno = EINVAL;
+        return -1;
+    }
+    file_io_detach(pdrv);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (num_sectors == 0) {
+        num_sectors = st.st_size / 512;
+    } else if (st.st_size < (off_t)num_sectors * 512 && ftruncate(fd, (off_t)num_sectors * 512) < 0) {
+        close(fd);
+        return -1;
+    }
+    image[pdrv].fd = fd;
+    image[pdrv].num_sectors = num_sectors;
+    return 0;
+}
+
+void file_io_detach(BYTE pdrv)
+{
+    if (pdrv < FF_VOLUMES && image[pdrv].fd >= 0) {
+        close(image[pdrv].fd);
+        image[pdrv].fd = -1;
+        status[pdrv] = STA_NOINIT;
+    }
+}
+
+void file_io_set_latency(BYTE pdrv, const file_io_latency_t * latency)
+{
+    if (pdrv < FF_VOLUMES) {
+        image[pdrv].latency = *latency;
+    }
+}
+
+/**
+ * \brief Waits for the simulated drive to complete an operation
+ * \param usec Latency of the operation in microseconds
+ */
+static void delay(uint32_t usec)
+{
+    if (usec) {
+        struct timespec ts = { .tv_sec = usec / 1000000, .tv_nsec = usec % 1000000 * 1000 };
+        while (nanosleep(&ts, &ts) < 0 && errno == EINTR);
+    }
+}
+
+/**
+ * \brief Checks that the sectors are within the drive
+ * \param pdrv Physical drive number
+ * \param sector Start sector in LBA
+ * \param count Number of sectors
+ * \return true if all sectors are within the drive
+ */
+static int in_range(BYTE pdrv, DWORD sector, UINT count)
+{
+    return sector < image[pdrv].num_sectors && count <= image[pdrv].num_sectors - sector;
+}
+
+/**
+ * \brief Transfers sectors between the image and several buffers
+ * \param pdrv Physical drive number
+ * \param seg Buffers
+ * \param nseg Number of buffers
+ * \param sector Start sector in LBA
+ * \param is_write Direction of the transfer
+ * \return RES_OK, RES_ERROR or RES_PARERR
+ */
+static DRESULT transfer(BYTE pdrv, const DSEG * seg, UINT nseg, DWORD sector, int is_write)
+{
+    struct iovec iov[FILE_IO_MAX_SEGS];
+    UINT count = 0;
+
+    for (UINT i = 0; i < nseg; i++) {
+        count += seg[i].count;
+    }
+    if (!in_range(pdrv, sector, count)) return RES_PARERR;
+
+    off_t pos = (off_t)sector * 512;
+    while (nseg) {
+        UINT n = nseg < FILE_IO_MAX_SEGS ? nseg : FILE_IO_MAX_SEGS;
+        size_t len = 0;
+        for (UINT i = 0; i < n; i++) {
+            iov[i].iov_base = seg[i].buff;
+            iov[i].iov_len = seg[i].count * 512;
+            len += iov[i].iov_len;
+        }
+        ssize_t res = is_write ? pwritev(image[pdrv].fd, iov, n, pos) : preadv(image[pdrv].fd, iov, n, pos);
+        if (res != (ssize_t)len) return RES_ERROR;
+        pos += len;
+        seg += n;
+        nseg -= n;
+    }
+
+    const file_io_latency_t * lat = &image[pdrv].latency;
+    delay((is_write ? lat->write : lat->read) + lat->sector * count);
+    return RES_OK;
+}
+
+/**
+ * \brief Get Drive Status
+ * \param pdrv Physical drive number to identify the drive
+ * \return drive status
+ */
+DSTATUS disk_status (BYTE pdrv)
+{
+    if (pdrv >= FF_VOLUMES) return STA_NOINIT;
+    return status[pdrv];
+}
+
+/**
+ * \brief Initialize a Drive
+ * \param pdrv Physical drive number to identify the drive
+ * \return drive status
+ */
+DSTATUS disk_initialize (BYTE pdrv)
+{
+    if (pdrv >= FF_VOLUMES) return STA_NOINIT;
+    if (image[pdrv].fd < 0) {
+        return status[pdrv] = STA_NOINIT | STA_NODISK;
+    }
+    return status[pdrv] = 0;
+}
+
+/**
+ * \brief Read Sector(s)
+ * \param pdrv Physical drive number to identify the drive
+ * \param buff Data buffer to store read data
+ * \param sector Start sector in LBA
+ * \param count Number of sectors to read
+ * \return RES_OK (0) The function succeeded.
+ *         RES_ERROR An unrecoverable hard error occured during the read operation.
+ *         RES_PARERR Invalid parameter.
+ *         RES_NOTRDY The device has not been initialized.
+ */
+DRESULT disk_read (BYTE pdrv, BYTE * buff, DWORD sector, UINT count)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    stats[pdrv].n_read++;
+    stats[pdrv].sc_read += count;
+
+    DSEG seg = { buff, count };
+    return transfer(pdrv, &seg, 1, sector, 0);
+}
+
+/**
+ * \brief Read Sector(s) into several buffers
+ * \param pdrv Physical drive number to identify the drive
+ * \param seg Buffers to store read data
+ * \param nseg Number of buffers
+ * \param sector Start sector in LBA
+ * \return the same as #disk_read
+ */
+DRESULT disk_readv (BYTE pdrv, const DSEG * seg, UINT nseg, DWORD sector)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    stats[pdrv].n_read++;
+    for (UINT i = 0; i < nseg; i++) {
+        stats[pdrv].sc_read += seg[i].count;
+    }
+    return transfer(pdrv, seg, nseg, sector, 0);
+}
+
+/**
+ * \brief Write Sector(s)
+ * \param pdrv Physical drive number to identify the drive
+ * \param buff Data to be written
+ * \param sector Start sector in LBA
+ * \param count Number of sectors to write
+ * \return RES_OK (0) The function succeeded.
+ *         RES_ERROR An unrecoverable hard error occured during the write operation.
+ *         RES_PARERR Invalid parameter.
+ *         RES_NOTRDY The device has not been initialized.
+ */
+DRESULT disk_write (BYTE pdrv, const BYTE * buff, DWORD sector, UINT count)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    stats[pdrv].n_write++;
+    stats[pdrv].sc_write += count;
+
+    DSEG seg = { (BYTE *)buff, count };
+    return transfer(pdrv, &seg, 1, sector, 1);
+}
+
+/**
+ * \brief Write Sector(s) gathered from several buffers
+ * \param pdrv Physical drive number to identify the drive
+ * \param seg Buffers with the data to be written
+ * \param nseg Number of buffers
+ * \param sector Start sector in LBA
+ * \return the same as #disk_write
+ */
+DRESULT disk_writev (BYTE pdrv, const DSEG * seg, UINT nseg, DWORD sector)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    stats[pdrv].n_write++;
+    for (UINT i = 0; i < nseg; i++) {
+        stats[pdrv].sc_write += seg[i].count;
+    }
+    return transfer(pdrv, seg, nseg, sector, 1);
+}
+
+/**
+ * \brief Miscellaneous Functions
+ * \param pdrv Physical drive nmuber (0..)
+ * \param cmd  Control code
+ * \param buff Buffer to send/receive control data
+ * \return RES_OK (0) The function succeeded.
+ *         RES_ERROR An error occured.
+ *         RES_PARERR The command code or parameter is invalid.
+ *         RES_NOTRDY The device has not been initialized.
+ */
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void * buff)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (cmd == CTRL_GET_STATS) {
+        *(DSTATS*)buff = stats[pdrv];
+        return RES_OK;
+    }
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    switch (cmd) {
+        case CTRL_SYNC: {
+            // The image is not fsync'ed - the benchmark measures FatFs and the
+            // simulated media, not the host's storage.
+            delay(image[pdrv].latency.sync);
+            break;
+        }
+        case GET_SECTOR_COUNT: {
+            *(DWORD*)buff = image[pdrv].num_sectors;
+            break;
+        }
+        case GET_SECTOR_SIZE: {
+            *(WORD*)buff = 512;
+            break;
+        }
+        case GET_BLOCK_SIZE: {
+            *(DWORD*)buff = 1;
+            break;
+        }
+        case CTRL_TRIM: {
+            break;
+        }
+        default: {
+            return RES_PARERR;
+        }
+    }
+    return RES_OK;
+}
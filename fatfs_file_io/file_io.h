@@ -0,0 +1,46 @@
+/**
+ * \file  file_io.h
+ * \brief FatFs drives backed by disk image files (host builds)
+ */
+#ifndef __FILE_IO_H
+#define __FILE_IO_H
+
+#include <ff.h>
+#include <stdint.h>
+
+/**
+ * \brief Simulated latency of the drive operations (in microseconds)
+ */
+typedef struct {
+    uint32_t read;      ///< Added to each read request
+    uint32_t write;     ///< Added to each write request
+    uint32_t sector;    ///< Added for each sector transferred
+    uint32_t sync;      ///< Added to each CTRL_SYNC
+} file_io_latency_t;
+
+/**
+ * \brief  Opens an image file as a drive
+ * \param  pdrv         Physical drive number
+ * \param  path         Image file
+ * \param  num_sectors  Size of the drive in 512-byte sectors. 0 uses the size
+ *                      of an existing image. A new image is created and an
+ *                      existing one is extended if it is smaller.
+ * \return 0 on success or -1 (errno tells why) if the image cannot be opened
+ * \note   The drive has to be attached before its volume is mounted.
+ */
+int file_io_attach(BYTE pdrv, const char * path, DWORD num_sectors);
+
+/**
+ * \brief  Closes the image of the drive
+ * \param  pdrv  Physical drive number
+ */
+void file_io_detach(BYTE pdrv);
+
+/**
+ * \brief  Sets the latency the drive simulates
+ * \param  pdrv     Physical drive number
+ * \param  latency  Latency of the drive operations
+ */
+void file_io_set_latency(BYTE pdrv, const file_io_latency_t * latency);
+
+#endif
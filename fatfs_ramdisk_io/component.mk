@@ -0,0 +1,3 @@
+ramdisk_fatfs_SRC_DIR = $(ramdisk_fatfs_ROOT)
+INC_DIRS += $(ramdisk_fatfs_ROOT)
+$(eval $(call component_compile_rules,ramdisk_fatfs))
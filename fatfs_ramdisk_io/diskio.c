@@ -0,0 +1,230 @@
+/**
+ * \file  diskio.c
+ * \brief FatFs disk I/O driver that keeps the disk image in RAM
+ */
+#include <ff.h>
+#include <diskio.h>
+#include "ramdisk_io.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if (FF_MIN_SS != FF_MAX_SS || FF_MIN_SS != 512)
+#error "Unsupported sector size"
+#endif
+
+/**
+ * \def   RAMDISK_IO_SECTORS
+ * \brief Number of 512-byte sectors that a drive allocates from the heap
+ *        when it was not given memory by #ramdisk_io_attach.
+ */
+#ifndef RAMDISK_IO_SECTORS
+#define RAMDISK_IO_SECTORS 128
+#endif
+
+/**
+ * \brief RAM disk drive
+ */
+typedef struct {
+    BYTE *  mem;            ///< Disk image
+    DWORD   num_sectors;    ///< Size of the image in sectors
+} ramdisk_t;
+
+static ramdisk_t disk[FF_VOLUMES];
+static DSTATUS status[FF_VOLUMES] = { [0 ... FF_VOLUMES - 1] = STA_NOINIT };
+static DSTATS stats[FF_VOLUMES];    ///< Number of read/write requests made by FatFs
+
+void ramdisk_io_attach(BYTE pdrv, BYTE * mem, DWORD num_sectors)
+{
+    if (pdrv < FF_VOLUMES) {
+        disk[pdrv].mem = mem;
+        disk[pdrv].num_sectors = num_sectors;
+        status[pdrv] = STA_NOINIT;
+    }
+}
+
+/**
+ * \brief Checks that the sectors are within the disk
+ * \param pdrv Physical drive number
+ * \param sector Start sector in LBA
+ * \param count Number of sectors
+ * \return pointer to the first sector in the disk image or NULL
+ */
+static BYTE * sector_ptr(BYTE pdrv, DWORD sector, UINT count)
+{
+    if (sector >= disk[pdrv].num_sectors || count > disk[pdrv].num_sectors - sector) {
+        return NULL;
+    }
+    return disk[pdrv].mem + (size_t)sector * 512;
+}
+
+/**
+ * \brief Get Drive Status
+ * \param pdrv Physical drive number to identify the drive
+ * \return drive status
+ */
+DSTATUS disk_status (BYTE pdrv)
+{
+    if (pdrv >= FF_VOLUMES) return STA_NOINIT;
+    return status[pdrv];
+}
+
+/**
+ * \brief Initialize a Drive
+ * \param pdrv Physical drive number to identify the drive
+ * \return drive status
+ *
+ * The image of a drive that was not attached is allocated here and
+ * its content is preserved across re-initializations.
+ */
+DSTATUS disk_initialize (BYTE pdrv)
+{
+    if (pdrv >= FF_VOLUMES) return STA_NOINIT;
+
+    if (!disk[pdrv].mem) {
+        disk[pdrv].mem = calloc(RAMDISK_IO_SECTORS, 512);
+        if (!disk[pdrv].mem) {
+            return status[pdrv] = STA_NOINIT | STA_NODISK;
+        }
+        disk[pdrv].num_sectors = RAMDISK_IO_SECTORS;
+    }
+    return status[pdrv] = 0;
+}
+
+/**
+ * \brief Read Sector(s)
+ * \param pdrv Physical drive number to identify the drive
+ * \param buff Data buffer to store read data
+ * \param sector Start sector in LBA
+ * \param count Number of sectors to read
+ * \return RES_OK (0) The function succeeded.
+ *         RES_PARERR Invalid parameter.
+ *         RES_NOTRDY The device has not been initialized.
+ */
+DRESULT disk_read (BYTE pdrv, BYTE * buff, DWORD sector, UINT count)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    BYTE * src = sector_ptr(pdrv, sector, count);
+    if (!src) return RES_PARERR;
+
+    stats[pdrv].n_read++;
+    stats[pdrv].sc_read += count;
+    memcpy(buff, src, count * 512);
+    return RES_OK;
+}
+
+/**
+ * \brief Read Sector(s) into several buffers
+ * \param pdrv Physical drive number to identify the drive
+ * \param seg Buffers to store read data
+ * \param nseg Number of buffers
+ * \param sector Start sector in LBA
+ * \return the same as #disk_read
+ */
+DRESULT disk_readv (BYTE pdrv, const DSEG * seg, UINT nseg, DWORD sector)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    stats[pdrv].n_read++;
+    for (UINT i = 0; i < nseg; i++) {
+        BYTE * src = sector_ptr(pdrv, sector, seg[i].count);
+        if (!src) return RES_PARERR;
+        stats[pdrv].sc_read += seg[i].count;
+        memcpy(seg[i].buff, src, seg[i].count * 512);
+        sector += seg[i].count;
+    }
+    return RES_OK;
+}
+
+/**
+ * \brief Write Sector(s)
+ * \param pdrv Physical drive number to identify the drive
+ * \param buff Data to be written
+ * \param sector Start sector in LBA
+ * \param count Number of sectors to write
+ * \return RES_OK (0) The function succeeded.
+ *         RES_PARERR Invalid parameter.
+ *         RES_NOTRDY The device has not been initialized.
+ */
+DRESULT disk_write (BYTE pdrv, const BYTE * buff, DWORD sector, UINT count)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    BYTE * dst = sector_ptr(pdrv, sector, count);
+    if (!dst) return RES_PARERR;
+
+    stats[pdrv].n_write++;
+    stats[pdrv].sc_write += count;
+    memcpy(dst, buff, count * 512);
+    return RES_OK;
+}
+
+/**
+ * \brief Write Sector(s) gathered from several buffers
+ * \param pdrv Physical drive number to identify the drive
+ * \param seg Buffers with the data to be written
+ * \param nseg Number of buffers
+ * \param sector Start sector in LBA
+ * \return the same as #disk_write
+ */
+DRESULT disk_writev (BYTE pdrv, const DSEG * seg, UINT nseg, DWORD sector)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    stats[pdrv].n_write++;
+    for (UINT i = 0; i < nseg; i++) {
+        BYTE * dst = sector_ptr(pdrv, sector, seg[i].count);
+        if (!dst) return RES_PARERR;
+        stats[pdrv].sc_write += seg[i].count;
+        memcpy(dst, seg[i].buff, seg[i].count * 512);
+        sector += seg[i].count;
+    }
+    return RES_OK;
+}
+
+/**
+ * \brief Miscellaneous Functions
+ * \param pdrv Physical drive nmuber (0..)
+ * \param cmd  Control code
+ * \param buff Buffer to send/receive control data
+ * \return RES_OK (0) The function succeeded.
+ *         RES_PARERR The command code or parameter is invalid.
+ *         RES_NOTRDY The device has not been initialized.
+ */
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void * buff)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (cmd == CTRL_GET_STATS) {
+        *(DSTATS*)buff = stats[pdrv];
+        return RES_OK;
+    }
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    switch (cmd) {
+        case CTRL_SYNC:
+        case CTRL_TRIM: {
+            // Every write is already complete and there is nothing to erase
+            break;
+        }
+        case GET_SECTOR_COUNT: {
+            *(DWORD*)buff = disk[pdrv].num_sectors;
+            break;
+        }
+        case GET_SECTOR_SIZE: {
+            *(WORD*)buff = 512;
+            break;
+        }
+        case GET_BLOCK_SIZE: {
+            *(DWORD*)buff = 1;
+            break;
+        }
+        default: {
+            return RES_PARERR;
+        }
+    }
+    return RES_OK;
+}
@@ -0,0 +1,21 @@
+/**
+ * \file  ramdisk_io.h
+ * \brief RAM disk for FatFs
+ */
+#ifndef __RAMDISK_IO_H
+#define __RAMDISK_IO_H
+
+#include <ff.h>
+
+/**
+ * \brief  Provides memory for a RAM disk drive
+ * \param  pdrv         Physical drive number
+ * \param  mem          Memory for the disk image (num_sectors * 512 bytes)
+ * \param  num_sectors  Size of the disk in 512-byte sectors
+ * \note   The drive has to be attached before its volume is mounted. A drive
+ *         that was not attached allocates `RAMDISK_IO_SECTORS` sectors from
+ *         the heap when it is initialized.
+ */
+void ramdisk_io_attach(BYTE pdrv, BYTE * mem, DWORD num_sectors);
+
+#endif
@@ -10,12 +10,96 @@
 #include <ff.h>			/* Obtains integer types */
 #include <diskio.h>		/* Declarations of disk functions */
 #include <sdcard.h>
+#include <esplibs/libmain.h>
+#include <stdbool.h>
+#include <string.h>
 
 #if (FF_MIN_SS != FF_MAX_SS || FF_MIN_SS != 512)
 #error "Unsupported sector size"
 #endif
 
+/**
+ * \def   SDCARD_IO_READ_AHEAD
+ * \brief Number of sectors that are prefetched into the read-ahead buffer
+ *        once sequential access is detected. 0 keeps the CMD18 stream open
+ *        across calls but does not prefetch.
+ */
+#ifndef SDCARD_IO_READ_AHEAD
+#define SDCARD_IO_READ_AHEAD 4
+#endif
+
+/**
+ * \def   SDCARD_IO_STREAM_TIMEOUT
+ * \brief Time (in microseconds) after which an idle read stream is considered
+ *        stale and is restarted even if the next read is sequential.
+ */
+#ifndef SDCARD_IO_STREAM_TIMEOUT
+#define SDCARD_IO_STREAM_TIMEOUT 500000
+#endif
+
+/**
+ * \def   SDCARD_IO_PROBE_INTERVAL
+ * \brief Time (in microseconds) the card may stay silent before #disk_status
+ *        probes it with CMD13 to make sure it is still there.
+ */
+#ifndef SDCARD_IO_PROBE_INTERVAL
+#define SDCARD_IO_PROBE_INTERVAL 1000000
+#endif
+
+/**
+ * \brief State of the open ended multiple block read
+ */
+typedef struct {
+    uint32_t    next;       ///< Sector the card will send next
+    uint32_t    last_used;  ///< Timestamp of the last stream access
+    bool        is_open;    ///< CMD18 has been sent and not stopped yet
+#if SDCARD_IO_READ_AHEAD > 0
+    uint32_t    count;      ///< Number of prefetched sectors that immediately precede `next`
+    uint8_t     buf[SDCARD_IO_READ_AHEAD * 512];
+#endif
+} read_stream_t;
+
 static sdcard_t card[FF_VOLUMES];
+static read_stream_t stream[FF_VOLUMES];
+static DSTATUS status[FF_VOLUMES] = { [0 ... FF_VOLUMES - 1] = STA_NOINIT };
+static uint32_t last_seen[FF_VOLUMES]; ///< Timestamp of the last successful card access
+static DSTATS stats[FF_VOLUMES];       ///< Number of read/write requests made by FatFs
+
+/**
+ * \brief Stops the read stream if it is open and drops prefetched data.
+ * \param pdrv Physical drive number
+ */
+static void close_stream(BYTE pdrv)
+{
+    read_stream_t * rs = &stream[pdrv];
+    if (rs->is_open) {
+        sdcard_read_stream_end(card[pdrv]);
+        rs->is_open = false;
+    }
+#if SDCARD_IO_READ_AHEAD > 0
+    rs->count = 0;
+#endif
+}
+
+/**
+ * \brief Updates drive status after an I/O operation.
+ * \param pdrv Physical drive number
+ * \param err  Result of the operation
+ * \return RES_OK or RES_ERROR
+ *
+ * A card that stopped responding is marked as not initialized, so the
+ * following requests fail immediately instead of waiting for timeouts
+ * and FatFs would re-initialize the drive when the volume is accessed.
+ */
+static DRESULT io_result(BYTE pdrv, sdcard_result_t err)
+{
+    if (err == SDCARD_ERROR_TIMEOUT) {
+        status[pdrv] |= STA_NOINIT;
+    } else if (!err) {
+        last_seen[pdrv] = sdk_system_relative_time(0);
+    }
+    return err ? RES_ERROR : RES_OK;
+}
 
 /**
  * \brief Get Drive Status
@@ -24,10 +108,34 @@ static sdcard_t card[FF_VOLUMES];
  */
 DSTATUS disk_status (BYTE pdrv)
 {
-    // The simple check here assumes that the hardware we are dealing with
-    // has no means to let us know whether a card has been removed (and thus
-    // any attempts to track the card initalization status are inherently futile)
-    return pdrv >= FF_VOLUMES ? STA_NOINIT : 0;
+    if (pdrv >= FF_VOLUMES) return STA_NOINIT;
+
+#ifdef SDCARD_CARD_DETECT
+    if (!sdcard_is_inserted(card[pdrv])) {
+        // Whatever card is inserted next it will need to be initialized
+        status[pdrv] = STA_NOINIT | STA_NODISK;
+        stream[pdrv].is_open = false;
+        return status[pdrv];
+    }
+    status[pdrv] &= ~STA_NODISK;
+#endif
+
+    // Without card detect switch the removal is noticed by probing the card
+    // that has been silent for a while. An open read stream means that the
+    // card has been reading data recently and it cannot be probed anyway.
+    if (!status[pdrv] && !stream[pdrv].is_open
+        && sdk_system_relative_time(last_seen[pdrv]) > SDCARD_IO_PROBE_INTERVAL
+    ) {
+        sdcard_result_t err = sdcard_get_status(card[pdrv]);
+        if (err == SDCARD_ERROR_TIMEOUT) {
+            status[pdrv] = STA_NOINIT | STA_NODISK;
+        } else if (err) {
+            status[pdrv] = STA_NOINIT;
+        } else {
+            last_seen[pdrv] = sdk_system_relative_time(0);
+        }
+    }
+    return status[pdrv];
 }
 
 /**
@@ -39,8 +147,107 @@ DSTATUS disk_initialize (BYTE pdrv)
 {
     if (pdrv >= FF_VOLUMES) return STA_NOINIT;
 
+#ifdef SDCARD_CARD_DETECT
+    if (!sdcard_is_inserted(card[pdrv])) {
+        stream[pdrv].is_open = false;
+        return status[pdrv] = STA_NOINIT | STA_NODISK;
+    }
+#endif
+    if (status[pdrv]) {
+        // A card that is not known to be alive might not accept CMD12 and
+        // the new one will be reset anyway
+        stream[pdrv].is_open = false;
+    }
+    close_stream(pdrv);
     sdcard_result_t err = sdcard_init(&card[pdrv]);
-    return err ? STA_NOINIT : 0;
+    if (err) {
+        status[pdrv] = err == SDCARD_ERROR_TIMEOUT ? STA_NOINIT | STA_NODISK : STA_NOINIT;
+    } else {
+        status[pdrv] = 0;
+        last_seen[pdrv] = sdk_system_relative_time(0);
+    }
+    return status[pdrv];
+}
+
+/**
+ * \brief Reads sectors via the read stream.
+ * \param pdrv Physical drive number
+ * \param buff Data buffer to store read data
+ * \param sector Start sector in LBA
+ * \param count Number of sectors to read
+ * \return RES_OK or RES_ERROR
+ */
+static DRESULT read_sectors(BYTE pdrv, BYTE * buff, DWORD sector, UINT count)
+{
+    read_stream_t * rs = &stream[pdrv];
+    bool is_sequential = false;
+
+#if SDCARD_IO_READ_AHEAD > 0
+    // Prefetched sectors are [next - count, next)
+    uint32_t first = rs->next - rs->count;
+    if (rs->count && first <= sector && sector < rs->next) {
+        uint32_t skip = sector - first;
+        uint32_t num_sectors = rs->count - skip;
+        if (num_sectors > count) {
+            num_sectors = count;
+        }
+        memcpy(buff, rs->buf + skip * 512, num_sectors * 512);
+        buff   += num_sectors * 512;
+        sector += num_sectors;
+        count  -= num_sectors;
+        is_sequential = true;
+    }
+#endif
+
+    if (count) {
+        if (rs->is_open && rs->next == sector && sdk_system_relative_time(rs->last_used) < SDCARD_IO_STREAM_TIMEOUT) {
+            is_sequential = true;
+        } else {
+            close_stream(pdrv);
+            sdcard_result_t err = sdcard_read_stream_begin(card[pdrv], sector);
+            if (err) {
+                return io_result(pdrv, err);
+            }
+            rs->is_open = true;
+            rs->next = sector;
+            is_sequential = false;
+        }
+#if SDCARD_IO_READ_AHEAD > 0
+        rs->count = 0;
+#endif
+        rs->next += count;
+        sdcard_result_t err = sdcard_read_stream(card[pdrv], count, buff);
+        if (err) {
+            if (err == SDCARD_ERROR_TIMEOUT) {
+                rs->is_open = false;
+            }
+            close_stream(pdrv);
+            return io_result(pdrv, err);
+        }
+    }
+
+#if SDCARD_IO_READ_AHEAD > 0
+    // Refill the read-ahead buffer once the access pattern looks sequential
+    // and whatever was prefetched before has been consumed. Large requests
+    // do not need it - the stream stays open for them anyway and prefetched
+    // data would have to be copied once more.
+    if (is_sequential && rs->is_open && sector + count == rs->next && count < SDCARD_IO_READ_AHEAD) {
+        sdcard_result_t err = sdcard_read_stream(card[pdrv], SDCARD_IO_READ_AHEAD, rs->buf);
+        if (err) {
+            // The requested data have been read already. Let the next request
+            // deal with the failure.
+            if (err == SDCARD_ERROR_TIMEOUT) {
+                rs->is_open = false;
+            }
+            close_stream(pdrv);
+        } else {
+            rs->next += SDCARD_IO_READ_AHEAD;
+            rs->count = SDCARD_IO_READ_AHEAD;
+        }
+    }
+#endif
+    rs->last_used = sdk_system_relative_time(0);
+    return io_result(pdrv, SDCARD_SUCCESS);
 }
 
 /**
@@ -57,9 +264,42 @@ DSTATUS disk_initialize (BYTE pdrv)
 DRESULT disk_read (BYTE pdrv, BYTE * buff, DWORD sector, UINT count)
 {
     if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
 
-    sdcard_result_t err = sdcard_read(card[pdrv], sector, count, buff);
-    return err ? RES_ERROR : RES_OK;
+    stats[pdrv].n_read++;
+    stats[pdrv].sc_read += count;
+
+    return read_sectors(pdrv, buff, sector, count);
+}
+
+/**
+ * \brief Read Sector(s) into several buffers
+ * \param pdrv Physical drive number to identify the drive
+ * \param seg Buffers to store read data
+ * \param nseg Number of buffers
+ * \param sector Start sector in LBA
+ * \return the same as #disk_read
+ *
+ * Consecutive sectors are read by a single CMD18 as the read stream stays
+ * open between the segments.
+ */
+DRESULT disk_readv (BYTE pdrv, const DSEG * seg, UINT nseg, DWORD sector)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    stats[pdrv].n_read++;
+    for (UINT i = 0; i < nseg; i++) {
+        if (seg[i].count) {
+            stats[pdrv].sc_read += seg[i].count;
+            DRESULT res = read_sectors(pdrv, seg[i].buff, sector, seg[i].count);
+            if (res) {
+                return res;
+            }
+            sector += seg[i].count;
+        }
+    }
+    return RES_OK;
 }
 
 /**
@@ -78,9 +318,43 @@ DRESULT disk_read (BYTE pdrv, BYTE * buff, DWORD sector, UINT count)
 DRESULT disk_write (BYTE pdrv, const BYTE * buff, DWORD sector, UINT count)
 {
     if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
 
+    stats[pdrv].n_write++;
+    stats[pdrv].sc_write += count;
+
+    // The card would not accept a write command while it is streaming data.
+    close_stream(pdrv);
     sdcard_result_t err = sdcard_write(card[pdrv], sector, count, buff);
-    return err ? RES_ERROR : RES_OK;
+    return io_result(pdrv, err);
+}
+
+/**
+ * \brief Write Sector(s) gathered from several buffers
+ * \param pdrv Physical drive number to identify the drive
+ * \param seg Buffers with the data to be written
+ * \param nseg Number of buffers
+ * \param sector Start sector in LBA
+ * \return the same as #disk_write
+ *
+ * All sectors are written by a single multiple block write.
+ */
+DRESULT disk_writev (BYTE pdrv, const DSEG * seg, UINT nseg, DWORD sector)
+{
+    if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
+
+    sdcard_seg_t segs[nseg];
+    stats[pdrv].n_write++;
+    for (UINT i = 0; i < nseg; i++) {
+        stats[pdrv].sc_write += seg[i].count;
+        segs[i].data = seg[i].buff;
+        segs[i].num_blocks = seg[i].count;
+    }
+
+    close_stream(pdrv);
+    sdcard_result_t err = sdcard_writev(card[pdrv], sector, nseg, segs);
+    return io_result(pdrv, err);
 }
 
 /**
@@ -96,6 +370,15 @@ DRESULT disk_write (BYTE pdrv, const BYTE * buff, DWORD sector, UINT count)
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void * buff)
 {
     if (pdrv >= FF_VOLUMES) return RES_PARERR;
+    if (cmd == CTRL_GET_STATS) {
+        // Returns numbers of disk_read and disk_write calls made so far (and sectors
+        // transferred by them) into the DSTATS variable pointed by buff. These can be
+        // compared before and after an operation to see how many disk requests it made.
+        // Available regardless of the drive state.
+        *(DSTATS*)buff = stats[pdrv];
+        return RES_OK;
+    }
+    if (status[pdrv] & STA_NOINIT) return RES_NOTRDY;
 
     switch (cmd) {
         case CTRL_SYNC: {
@@ -104,6 +387,8 @@ DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void * buff)
             // must be written back to the media immediately.
             // Nothing to do for this command if each write operation to
             // the media is completed within the disk_write function.
+            // However, a read stream left open would keep the card busy.
+            close_stream(pdrv);
             break;
         }
         case GET_SECTOR_COUNT: {
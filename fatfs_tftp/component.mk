@@ -0,0 +1,3 @@
+fatfs_tftp_SRC_DIR = $(fatfs_tftp_ROOT)
+INC_DIRS += $(fatfs_tftp_ROOT)
+$(eval $(call component_compile_rules,fatfs_tftp))
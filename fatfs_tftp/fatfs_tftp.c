@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <lwip/apps/tftp_server.h>
+#include <ff.h>
+#include <ffpbuf.h>
+
+#ifdef FATFS_TFTP_DEBUG
+#define LOG(fmt,...) printf("FAT> " fmt,## __VA_ARGS__)
+#else
+#define LOG(fmt,...)
+#endif
+
+/**
+ * \brief Success code for TFTP `read` and `write` functions
+ */
+#define OK   0
+/**
+ * \brief Failure code for TFTP `read` and `write` functions
+ */
+#define ERR -1
+
+static inline FIL * file(void * handle)
+{
+    return (FIL *) handle;
+}
+
+static void * tftp_open(const char * fname, const char * mode, uint8_t write)
+{
+    LOG("%s %s\n", (write ? "write" : "read"), fname);
+    FIL * fp = malloc(sizeof(FIL));
+    if (fp) {
+        FRESULT res = f_open(fp, fname, write ? FA_WRITE | FA_CREATE_ALWAYS : FA_READ);
+        if (res != FR_OK) {
+            LOG("cannot open %s: %d\n", fname, res);
+            free(fp);
+            fp = NULL;
+        }
+    }
+    return fp;
+}
+
+static void tftp_close(void * handle)
+{
+    LOG("close\n");
+    f_close(file(handle));
+    free(handle);
+}
+
+/**
+ * \brief Reads the next block of the file
+ *
+ * `buf` is the payload of the data packet that the TFTP server has allocated,
+ * so the data are read straight into the pbuf. The blocks start at multiples of
+ * 512, thus each one is a whole sector that `f_read` gets directly from the disk.
+ */
+static int tftp_read(void * handle, void * buf, int bytes)
+{
+    UINT num_read;
+    FRESULT res = f_read(file(handle), buf, bytes, &num_read);
+    if (res != FR_OK) {
+        LOG("read failed: %d\n", res);
+        return ERR;
+    }
+    return num_read;
+}
+
+static int tftp_write(void * handle, struct pbuf * p)
+{
+    UINT num_written;
+    FRESULT res = ffpbuf_write(file(handle), p, &num_written);
+    if (res != FR_OK || num_written < p->tot_len) {
+        LOG("write failed: %d\n", res);
+        return ERR;
+    }
+    return OK;
+}
+
+struct tftp_context const FATFS_VFS = {
+    .open  = tftp_open,
+    .close = tftp_close,
+    .read  = tftp_read,
+    .write = tftp_write
+};
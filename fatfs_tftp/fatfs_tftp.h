@@ -0,0 +1,28 @@
+/**
+ * \file  fatfs_tftp.h
+ * \brief TFTP VFS for files on FatFs volumes
+ *
+ * The FatFs VFS serves the TFTP requests with files on mounted FatFs volumes.
+ * The "remote name" of a request is used as the FatFs path, for example:
+ * \code
+ *   tftp -m binary 10.0.0.11 -c get logs/today.log
+ *   tftp -m binary 10.0.0.11 -c put config.json 1:/etc/config.json
+ * \endcode
+ * A get reads the file directly into the payload of the data packet, a put
+ * creates (or overwrites) the file and writes the payloads of the received
+ * packets into it.
+ */
+#ifndef __FATFS_TFTP_H
+#define __FATFS_TFTP_H
+
+#include <lwip/apps/tftp_server.h>
+
+/**
+ * \brief TFTP context for the files on FatFs volumes
+ *
+ * It accepts any file name it can open, thus it should be the last one
+ * in the list of VFS contexts passed to `tftp_vfs_init`.
+ */
+extern struct tftp_context const FATFS_VFS;
+
+#endif
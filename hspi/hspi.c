@@ -235,7 +235,19 @@ void hspi_get_data(uint32_t buf_len, void * buf)
         if (buf_len > sizeof(HSPI.W)) {
             buf_len = sizeof(HSPI.W);
         }
-        memcpy(buf, (const void *)HSPI.W, buf_len);
+        if ((uintptr_t)buf & 3) {
+            memcpy(buf, (const void *)HSPI.W, buf_len);
+        } else {
+            uint32_t * buf_ptr = buf;
+            const uint32_t * w = (const uint32_t*)HSPI.W;
+            const uint32_t * end = w + buf_len / 4;
+            while (w < end) {
+                *buf_ptr++ = *w++;
+            }
+            if (buf_len & 3) {
+                memcpy(buf_ptr, w, buf_len & 3);
+            }
+        }
     }
 }
 
@@ -211,6 +211,7 @@ static inline void hspi_wait()
  * The actual number of bits sent by a slave was specified in the `hspi_exec` function.
  * It is up to the caller to get all of them, less than received or more than recieved and
  * interpret the copied data accordingly.
+ * Word aligned buffers are filled with 32-bit loads straight from the registers.
  *
  * \param buf_len Length of the buffer in **bytes** (1..64).
  * \param buf     Buffer to copy data to.
@@ -41,3 +41,38 @@ static inline bool sdcard_is_sdhc(sdcard_t card)
 {
     return false;
 }
+
+/**
+ * \def   SDCARD_CARD_DETECT
+ * \brief Enables support for the card detect switch of the SD card slot.
+ *
+ * When defined the program has to implement #sdcard_is_inserted, which
+ * drivers (like fatfs_sdcard_io) use to notice card removal without
+ * waiting for I/O operations to time out.
+ *
+ * \code
+ * #define SDCARD_CARD_DETECT
+ * \endcode
+ */
+
+/**
+ * \brief Reports the state of the card detect switch
+ * \param card Card descriptor
+ * \return `true` if there is a card in the slot.
+ *
+ * For example, if the slot's card detect switch is wired to GPIO5 and
+ * closes to ground when a card is inserted:
+ * \code
+ * static inline bool sdcard_is_inserted(sdcard_t card)
+ * {
+ *     return !gpio_read(5);
+ * }
+ * \endcode
+ *
+ * \note this function does not need to be implemented when #SDCARD_CARD_DETECT
+ *       is undefined.
+ */
+static inline bool sdcard_is_inserted(sdcard_t card)
+{
+    return true;
+}
@@ -288,6 +288,57 @@ done:
     return err;
 }
 
+sdcard_result_t sdcard_read_stream_begin(sdcard_t card, uint32_t addr)
+{
+    sdcard_result_t err = SDCARD_SUCCESS;
+    hspi_select(card);
+    if (!sdcard_is_sdhc(card)) {
+        addr <<= 9;
+    }
+    set_cs_low();
+    uint8_t resp = r1cmd(18, addr, 0xff);
+    if (resp & 0x80) {
+        raise_error(SDCARD_ERROR_TIMEOUT);
+    }
+    if (resp != 0) {
+        raise_error(SDCARD_ERROR_IO);
+    }
+done:
+    set_cs_high();
+    hspi_release();
+    return err;
+}
+
+sdcard_result_t sdcard_read_stream(sdcard_t card, uint32_t num_blocks, uint8_t * data)
+{
+    sdcard_result_t err = SDCARD_SUCCESS;
+    hspi_select(card);
+    set_cs_low();
+    while (!err && num_blocks) {
+        err = read_data(512, data);
+        data += 512;
+        --num_blocks;
+    }
+    set_cs_high();
+    hspi_release();
+    return err;
+}
+
+sdcard_result_t sdcard_read_stream_end(sdcard_t card)
+{
+    sdcard_result_t err = SDCARD_SUCCESS;
+    hspi_select(card);
+    set_cs_low();
+    // The byte that immediately follows CMD12 is a stuff byte that might be
+    // a leftover of the data transfer. Thus only "no response" is checked.
+    if (r1cmd(12, 0, 0x61) & 0x80) {
+        err = SDCARD_ERROR_TIMEOUT;
+    }
+    set_cs_high();
+    hspi_release();
+    return err;
+}
+
 static sdcard_result_t sdcard_read_register(sdcard_t card, uint8_t * data, uint8_t cmd, uint8_t crc)
 {
     sdcard_result_t err = SDCARD_SUCCESS;
@@ -328,6 +379,29 @@ sdcard_result_t sdcard_read_csd(sdcard_t card, sdcard_csd_t * csd)
     return err;
 }
 
+sdcard_result_t sdcard_get_status(sdcard_t card)
+{
+    sdcard_result_t err = SDCARD_SUCCESS;
+    hspi_select(card);
+    set_cs_low();
+    uint8_t resp = r1cmd(13, 0, 0xff);
+    if (resp & 0x80) {
+        raise_error(SDCARD_ERROR_TIMEOUT);
+    }
+    // R2 has the second status byte. Clock it out even though only R1 matters here.
+    hspi_reset();
+    hspi_set_pattern(8, 0xff);
+    hspi_exec();
+    hspi_wait();
+    if (resp != 0) {
+        raise_error(SDCARD_ERROR_IO);
+    }
+done:
+    set_cs_high();
+    hspi_release();
+    return err;
+}
+
 uint32_t sdcard_get_size(sdcard_t card)
 {
     uint8_t data[16];
@@ -393,28 +467,47 @@ static sdcard_result_t end_transmission()
 }
 
 sdcard_result_t sdcard_write(sdcard_t card, uint32_t addr, uint32_t num_blocks, const uint8_t * data)
+{
+    sdcard_seg_t seg = { .data = data, .num_blocks = num_blocks };
+    return sdcard_writev(card, addr, 1, &seg);
+}
+
+sdcard_result_t sdcard_writev(sdcard_t card, uint32_t addr, uint32_t num_segs, const sdcard_seg_t * segs)
 {
     sdcard_result_t err = SDCARD_SUCCESS;
+    uint32_t num_blocks = 0;
+    for (uint32_t i = 0; i < num_segs; i++) {
+        num_blocks += segs[i].num_blocks;
+    }
+    if (num_blocks == 0) {
+        return err;
+    }
     hspi_select(card);
     if (!sdcard_is_sdhc(card)) {
         addr <<= 9;
     }
     set_cs_low();
     if (num_blocks == 1) {
-        if (r1cmd(24,addr,0xff) || write_block(0xfe, data)) {
+        while (segs->num_blocks == 0) {
+            ++segs;
+        }
+        if (r1cmd(24,addr,0xff) || write_block(0xfe, segs->data)) {
             raise_error(SDCARD_ERROR_IO);
         }
     } else {
         if (acmd(23,num_blocks,0xff) || r1cmd(25,addr,0xff)) {
             raise_error(SDCARD_ERROR_IO);
         }
-        err = write_block(0xfc, data);
-        while (!err && --num_blocks) {
-            data += 512;
-            if (!wait_until_card_not_busy()) {
-                raise_error(SDCARD_ERROR_TIMEOUT);
+        bool is_first = true;
+        for (; !err && num_segs; --num_segs, ++segs) {
+            const uint8_t * data = segs->data;
+            for (uint32_t n = segs->num_blocks; !err && n; --n, data += 512) {
+                if (!is_first && !wait_until_card_not_busy()) {
+                    raise_error(SDCARD_ERROR_TIMEOUT);
+                }
+                is_first = false;
+                err = write_block(0xfc, data);
             }
-            err = write_block(0xfc, data);
         }
         if (err) {
             // In case of any error (CRC or Write) during Write Multiple Block operation,
@@ -43,6 +43,41 @@ sdcard_result_t sdcard_init(sdcard_t * card);
  */
 sdcard_result_t sdcard_read(sdcard_t card, uint32_t block, uint32_t num_blocks, uint8_t * data);
 
+/**
+ * \brief  Starts an open ended multiple block read (CMD18)
+ * \param  card   Card descriptor
+ * \param  block  First block of the stream
+ * \return SDCARD_SUCCESS        if card accepted the read request
+ *         SDCARD_ERROR_TIMEOUT  if card was still busy finishing previous operation
+ *                               and did not respond to the read request
+ *         SDCARD_ERROR_IO       if card rejected the read command
+ * \note   The card is deselected and HSPI is released between the stream calls.
+ *         The card keeps its data transfer state while its CS is high, thus other
+ *         SPI devices may use the bus while the stream remains open. However,
+ *         no other command can be sent to this card until #sdcard_read_stream_end
+ *         closes the stream.
+ */
+sdcard_result_t sdcard_read_stream_begin(sdcard_t card, uint32_t block);
+
+/**
+ * \brief  Reads next blocks from the stream opened by #sdcard_read_stream_begin
+ * \param       card        Card descriptor
+ * \param       num_blocks  Number of 512-byte blocks to read
+ * \param[out]  data        Pointer to the destination buffer
+ * \return SDCARD_SUCCESS        if data were transfered from card into the buffer
+ *         SDCARD_ERROR_TIMEOUT  if card did not send the data block in time
+ *         SDCARD_ERROR_CRC      if data were corrupted during transfer (CRC did not match)
+ */
+sdcard_result_t sdcard_read_stream(sdcard_t card, uint32_t num_blocks, uint8_t * data);
+
+/**
+ * \brief  Closes the stream opened by #sdcard_read_stream_begin (CMD12)
+ * \param  card  Card descriptor
+ * \return SDCARD_SUCCESS        if card stopped the transmission
+ *         SDCARD_ERROR_TIMEOUT  if card did not respond to the stop command
+ */
+sdcard_result_t sdcard_read_stream_end(sdcard_t card);
+
 /**
  * \brief  Writes data (blocks) to the SD card
  * \param  card        Card descriptor
@@ -58,6 +93,27 @@ sdcard_result_t sdcard_read(sdcard_t card, uint32_t block, uint32_t num_blocks,
  */
 sdcard_result_t sdcard_write(sdcard_t card, uint32_t block, uint32_t num_blocks, const uint8_t * data);
 
+/**
+ * \brief Segment of data for #sdcard_writev
+ */
+typedef struct {
+    const uint8_t * data;       ///< Pointer to the data
+    uint32_t        num_blocks; ///< Number of 512-byte blocks in the segment
+} sdcard_seg_t;
+
+/**
+ * \brief  Writes data gathered from several buffers to consecutive blocks of the SD card
+ * \param  card      Card descriptor
+ * \param  block     First block to write data to
+ * \param  num_segs  Number of segments
+ * \param  segs      Data segments that are written one after another
+ * \return the same as #sdcard_write
+ * \note   All segments are written by a single multiple block write (CMD25), thus
+ *         the card does not have to finish programming and accept a new write
+ *         command for each of them.
+ */
+sdcard_result_t sdcard_writev(sdcard_t card, uint32_t block, uint32_t num_segs, const sdcard_seg_t * segs);
+
 /**
  * \brief  Erases SD card blocks
  * \param  card        Card descriptor
@@ -96,6 +152,19 @@ sdcard_result_t sdcard_read_cid(sdcard_t card, sdcard_cid_t * data);
  */
 sdcard_result_t sdcard_read_csd(sdcard_t card, sdcard_csd_t * data);
 
+/**
+ * \brief  Probes the card with SEND_STATUS (CMD13)
+ * \param  card  Card descriptor
+ * \return SDCARD_SUCCESS        if card responded and reported no errors
+ *         SDCARD_ERROR_TIMEOUT  if card did not respond (maybe it was removed)
+ *         SDCARD_ERROR_IO       if card reported an error or is in the idle state
+ *                               (which happens when a card was replaced and needs
+ *                               to be initialized)
+ * \note   The probe is cheap when there is no card in the slot as MISO is pulled
+ *         high and the missing response is detected within a few bytes.
+ */
+sdcard_result_t sdcard_get_status(sdcard_t card);
+
 /**
  * \brief  Reads card size in 512 byte blocks
  * \param  card  Card descriptor